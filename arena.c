@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include "arena.h"
+
+#define ARENA_ALIGN(s) (((s) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static struct arena_block *new_block(size_t size) {
+    if (size < ARENA_BLOCK_SIZE) {
+        size = ARENA_BLOCK_SIZE;
+    }
+    struct arena_block *b = (struct arena_block *)malloc(sizeof(struct arena_block) + size);
+    if (b == NULL) {
+        return NULL;
+    }
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+void arena_init(struct arena *a) {
+    a->head = NULL;
+    a->cur = NULL;
+    a->allocated = 0;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    struct arena_block *b = a->cur;
+    size = ARENA_ALIGN(size);
+    if (b == NULL) {
+        b = new_block(size);
+        if (b == NULL) {
+            return NULL;
+        }
+        a->head = a->cur = b;
+    } else if (b->used + size > b->size) {
+        // 优先复用上次留下的块
+        struct arena_block *next = b->next;
+        if (next == NULL || next->size < size) {
+            next = new_block(size);
+            if (next == NULL) {
+                return NULL;
+            }
+            next->next = b->next;
+            b->next = next;
+        }
+        next->used = 0;
+        a->cur = b = next;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    a->allocated += size;
+    return p;
+}
+
+void arena_reset(struct arena *a) {
+    a->cur = a->head;
+    a->allocated = 0;
+    if (a->head) {
+        a->head->used = 0;
+    }
+}
+
+size_t arena_memory(const struct arena *a) {
+    size_t bytes = 0;
+    const struct arena_block *b;
+    for (b = a->head; b; b = b->next) {
+        bytes += sizeof(struct arena_block) + b->size;
+    }
+    return bytes;
+}
+
+void arena_destroy(struct arena *a) {
+    struct arena_block *b = a->head;
+    while (b) {
+        struct arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->cur = NULL;
+}
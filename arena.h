@@ -0,0 +1,32 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__ 0
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+struct arena_block {
+    struct arena_block *next;
+    size_t size;
+    size_t used;
+    char data[0];
+};
+
+/*
+    按块增长的线性分配器, 块在 reset 之后保留复用,
+    稳定状态下寻路不再调用 malloc
+*/
+struct arena {
+    struct arena_block *head;
+    struct arena_block *cur;
+    size_t allocated; // 上次 reset 以来分配出去的字节数
+};
+
+void arena_init(struct arena *a);
+void *arena_alloc(struct arena *a, size_t size);
+void arena_reset(struct arena *a);
+void arena_destroy(struct arena *a);
+// 已向系统申请的字节数, 包括块头
+size_t arena_memory(const struct arena *a);
+
+#endif /* __ARENA_H__ */
@@ -0,0 +1,328 @@
+/*
+    寻路性能基准, 不依赖 Lua:
+    用固定种子生成几类地图(随机、迷宫、房间、SLG 大地图、开阔地图), 每张图跑一组固定的查询,
+    统计 search_ipath + 平滑的 p50/p99/max 耗时、展开节点数、节点内存和平均路径长度.
+
+    用法: bench [地图边长] [每张图的查询数]
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hpa.h"
+#include "jps.h"
+#include "map.h"
+#include "path.h"
+#include "smooth.h"
+#include "tile.h"
+
+#define DEFAULT_SIZE 512
+#define DEFAULT_QUERIES 100
+#define SEED 20240601
+
+// xorshift64*, 保证不同平台生成同样的地图和查询
+static uint64_t rng_state;
+
+static void rng_seed(uint64_t seed) {
+    rng_state = seed * 2685821657736338717ULL + 1;
+}
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 2685821657736338717ULL) >> 32);
+}
+
+static int rng_range(int n) {
+    return rng_next() % n;
+}
+
+static Map* new_map(int w, int h) {
+    Map* m = (Map*)malloc(sizeof(Map));
+    init_map(m, w, h);
+    return m;
+}
+
+static void free_map(Map* m) {
+    map_destroy(m);
+    free(m);
+}
+
+static void block_rect(Map* m, int x0, int y0, int x1, int y1) {
+    int x, y;
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            if (check_in_map(x, y, m->width, m->height)) {
+                map_set_block(m, xy2pos(m, x, y));
+            }
+        }
+    }
+}
+
+static void clear_rect(Map* m, int x0, int y0, int x1, int y1) {
+    int x, y;
+    for (y = y0; y <= y1; y++) {
+        for (x = x0; x <= x1; x++) {
+            if (check_in_map(x, y, m->width, m->height)) {
+                map_clear_block(m, xy2pos(m, x, y));
+            }
+        }
+    }
+}
+
+// 20% 随机阻挡
+static void gen_random(Map* m) {
+    int i, len = m->width * m->height;
+    for (i = 0; i < len / 5; i++) {
+        map_set_block(m, rng_range(len));
+    }
+}
+
+// 通道宽 MAZE_PITCH - 1 格的完美迷宫, 深度优先生成
+#define MAZE_PITCH 4
+
+static void maze_open(Map* m, int cx, int cy, int nx, int ny) {
+    int x0 = (cx < nx ? cx : nx) * MAZE_PITCH + 1;
+    int y0 = (cy < ny ? cy : ny) * MAZE_PITCH + 1;
+    int x1 = (cx > nx ? cx : nx) * MAZE_PITCH + MAZE_PITCH - 1;
+    int y1 = (cy > ny ? cy : ny) * MAZE_PITCH + MAZE_PITCH - 1;
+    clear_rect(m, x0, y0, x1, y1);
+}
+
+static void gen_maze(Map* m) {
+    int cw = (m->width - 1) / MAZE_PITCH, ch = (m->height - 1) / MAZE_PITCH;
+    int* stack = (int*)malloc(cw * ch * sizeof(int));
+    char* seen = (char*)calloc(cw * ch, 1);
+    int top = 0;
+    block_rect(m, 0, 0, m->width - 1, m->height - 1);
+    stack[top++] = 0;
+    seen[0] = 1;
+    maze_open(m, 0, 0, 0, 0);
+    while (top > 0) {
+        int cur = stack[top - 1];
+        int cx = cur % cw, cy = cur / cw;
+        int next[4], n = 0;
+        if (cx > 0 && !seen[cur - 1]) next[n++] = cur - 1;
+        if (cx < cw - 1 && !seen[cur + 1]) next[n++] = cur + 1;
+        if (cy > 0 && !seen[cur - cw]) next[n++] = cur - cw;
+        if (cy < ch - 1 && !seen[cur + cw]) next[n++] = cur + cw;
+        if (n == 0) {
+            top--;
+            continue;
+        }
+        int nb = next[rng_range(n)];
+        seen[nb] = 1;
+        maze_open(m, cx, cy, nb % cw, nb / cw);
+        stack[top++] = nb;
+    }
+    free(stack);
+    free(seen);
+}
+
+// 32x32 的房间, 每面墙上开一个门, 房间内有少量杂物
+static void gen_rooms(Map* m) {
+    const int room = 32;
+    int x, y, i;
+    for (y = 0; y < m->height; y += room) {
+        block_rect(m, 0, y, m->width - 1, y);
+    }
+    for (x = 0; x < m->width; x += room) {
+        block_rect(m, x, 0, x, m->height - 1);
+    }
+    for (y = 0; y < m->height; y += room) {
+        for (x = 0; x < m->width; x += room) {
+            int d = 2 + rng_range(room - 6);
+            clear_rect(m, x + d, y, x + d + 2, y);
+            d = 2 + rng_range(room - 6);
+            clear_rect(m, x, y + d, x, y + d + 2);
+            for (i = 0; i < 6; i++) {
+                int ox = x + 3 + rng_range(room - 8);
+                int oy = y + 3 + rng_range(room - 8);
+                block_rect(m, ox, oy, ox + rng_range(3), oy + rng_range(3));
+            }
+        }
+    }
+}
+
+// SLG 大地图: 大片空地, 几道贯穿全图的长城带少量关口, 加上散布的山体
+static void gen_slg(Map* m) {
+    int i, k;
+    for (i = 0; i < 6; i++) {
+        int vertical = i % 2;
+        int at = (vertical ? m->width : m->height) * (i / 2 + 1) / 4;
+        int len = vertical ? m->height : m->width;
+        if (vertical) {
+            block_rect(m, at, 0, at + 1, len - 1);
+        } else {
+            block_rect(m, 0, at, len - 1, at + 1);
+        }
+        for (k = 0; k < 3; k++) {
+            int p = rng_range(len - 8);
+            if (vertical) {
+                clear_rect(m, at, p, at + 1, p + 4);
+            } else {
+                clear_rect(m, p, at, p + 4, at + 1);
+            }
+        }
+    }
+    int mountains = m->width * m->height / 4096;
+    for (i = 0; i < mountains; i++) {
+        int x = rng_range(m->width), y = rng_range(m->height);
+        int r = 2 + rng_range(12);
+        block_rect(m, x - r, y - r / 2, x + r, y + r / 2);
+    }
+}
+
+// 开阔地图: 只有零星成团的阻挡, 大部分分块是空的
+static void gen_open(Map* m) {
+    int i;
+    int clumps = m->width * m->height / 16384;
+    for (i = 0; i < clumps; i++) {
+        int x = rng_range(m->width), y = rng_range(m->height);
+        int r = 1 + rng_range(6);
+        block_rect(m, x - r, y - r, x + r, y + r);
+    }
+}
+
+struct corpus {
+    const char* name;
+    void (*gen)(Map* m);
+};
+
+struct mode {
+    const char* name;
+    char open_list;
+    int jps_plus;
+    int hpa; // 簇边长, 0 表示不用分层寻路
+    int tiles; // 开启分块统计
+    int smooth; // SMOOTH_* 平滑方式
+    char search; // SEARCH_JPS / SEARCH_THETA / SEARCH_BIDIR
+};
+
+static int random_walkable(Map* m) {
+    int len = m->width * m->height;
+    for (;;) {
+        int pos = rng_range(len);
+        if (!map_blocked(m, pos)) {
+            return pos;
+        }
+    }
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// 路点之间的直线距离之和, 单位为格
+static double path_length(Map* m, SearchContext* s) {
+    double len = 0;
+    int i, x1, y1, x2, y2;
+    for (i = 1; i < s->ipath_len; i++) {
+        pos2xy(m, s->ipath[i - 1], &x1, &y1);
+        pos2xy(m, s->ipath[i], &x2, &y2);
+        len += sqrt((double)(x1 - x2) * (x1 - x2) + (double)(y1 - y2) * (y1 - y2));
+    }
+    return len;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void run(Map* m, const char* corpus, const struct mode* mode,
+                const int* queries, int nquery) {
+    SearchContext* s = &m->ctx;
+    double* cost = (double*)malloc(nquery * sizeof(double));
+    long long expanded = 0, bytes = 0;
+    double length = 0;
+    int i, found = 0;
+    s->open_list = mode->open_list;
+    s->search = mode->search;
+    if (mode->jps_plus) {
+        jps_plus_build(m);
+    }
+    if (mode->hpa) {
+        hpa_build(m, mode->hpa);
+        hpa_refresh(m);
+    }
+    if (mode->tiles) {
+        tiles_build(m);
+    }
+    for (i = 0; i < nquery; i++) {
+        s->start = queries[2 * i];
+        s->end = queries[2 * i + 1];
+        double t = now_us();
+        int ok = search_ipath(m, s);
+        if (ok) {
+            smooth_ipath(m, s, mode->smooth);
+        }
+        cost[i] = now_us() - t;
+        if (ok) {
+            found++;
+            length += path_length(m, s);
+        }
+        expanded += s->expanded;
+        bytes += s->arena.allocated;
+    }
+    jps_plus_free(m);
+    hpa_free(m);
+    tiles_free(m);
+    qsort(cost, nquery, sizeof(double), compare_double);
+    printf("%-8s %-12s %6d %6d %10.1f %10.1f %10.1f %10lld %10lld %10.1f\n",
+           corpus, mode->name, nquery, found,
+           cost[nquery / 2], cost[(nquery * 99) / 100], cost[nquery - 1],
+           expanded / nquery, bytes / nquery, found ? length / found : 0);
+    free(cost);
+}
+
+int main(int argc, char* argv[]) {
+    int size = argc > 1 ? atoi(argv[1]) : DEFAULT_SIZE;
+    int nquery = argc > 2 ? atoi(argv[2]) : DEFAULT_QUERIES;
+    static const struct corpus corpora[] = {
+        {"random", gen_random},
+        {"maze", gen_maze},
+        {"rooms", gen_rooms},
+        {"slg", gen_slg},
+        {"open", gen_open},
+    };
+    static const struct mode modes[] = {
+        {"fibheap", OPEN_LIST_FIBHEAP, 0, 0, 0, SMOOTH_FULL, SEARCH_JPS},
+        {"dheap", OPEN_LIST_DHEAP, 0, 0, 0, SMOOTH_FULL, SEARCH_JPS},
+        {"dheap+jps+", OPEN_LIST_DHEAP, 1, 0, 0, SMOOTH_FULL, SEARCH_JPS},
+        {"dheap+hpa", OPEN_LIST_DHEAP, 0, HPA_CLUSTER_SIZE, 0, SMOOTH_FULL, SEARCH_JPS},
+        {"dheap+tiles", OPEN_LIST_DHEAP, 0, 0, 1, SMOOTH_FULL, SEARCH_JPS},
+        {"dheap+linear", OPEN_LIST_DHEAP, 0, 0, 0, SMOOTH_LINEAR, SEARCH_JPS},
+        {"dheap+theta", OPEN_LIST_DHEAP, 0, 0, 0, SMOOTH_NONE, SEARCH_THETA},
+        {"dheap+bidir", OPEN_LIST_DHEAP, 0, 0, 0, SMOOTH_FULL, SEARCH_BIDIR},
+    };
+    int* queries = (int*)malloc(nquery * 2 * sizeof(int));
+    size_t c, k;
+    int i;
+
+    printf("map %dx%d, %d queries per map, seed %d\n", size, size, nquery, SEED);
+    printf("%-8s %-12s %6s %6s %10s %10s %10s %10s %10s %10s\n",
+           "corpus", "mode", "query", "found", "p50(us)", "p99(us)", "max(us)",
+           "expanded", "bytes", "length");
+    for (c = 0; c < sizeof(corpora) / sizeof(corpora[0]); c++) {
+        rng_seed(SEED + c);
+        Map* m = new_map(size, size);
+        corpora[c].gen(m);
+        for (i = 0; i < nquery; i++) {
+            queries[2 * i] = random_walkable(m);
+            queries[2 * i + 1] = random_walkable(m);
+        }
+        for (k = 0; k < sizeof(modes) / sizeof(modes[0]); k++) {
+            run(m, corpora[c].name, &modes[k], queries, nquery);
+        }
+        free_map(m);
+    }
+    free(queries);
+    return 0;
+}
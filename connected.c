@@ -0,0 +1,471 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "connected.h"
+
+// 计算连通区域用的队列和 visited 第一次用到时才分配, 只寻路的地图不需要
+static void connected_prepare(Map* m) {
+    if (!m->queue) {
+        int len = m->width * m->height;
+        m->queue = (int*)malloc(len * sizeof(int));
+        m->visited = (char*)calloc(len, sizeof(char)); // 增量重标记要求不用时全为 0
+    }
+}
+
+// 保证标号 id 在并查集里, 新标号各自成一个区域
+static void uf_reserve(Map* m, int id) {
+    int i;
+    if (id > CONNECTED_NARROW_MAX && !m->connected_wide) {
+        map_set_connected_wide(m, 1);
+    }
+    if (id >= m->uf_cap) {
+        int cap = m->uf_cap ? m->uf_cap : 64;
+        while (cap <= id && cap <= INT_MAX / 2) {
+            cap *= 2;
+        }
+        if (cap <= id) {
+            cap = id + 1;
+        }
+        m->uf_parent = (int*)realloc(m->uf_parent, cap * sizeof(int));
+        m->uf_parent[0] = 0; // 阻挡格和未标记的格子是 0
+        m->uf_cap = cap;
+    }
+    for (i = m->mark_connected + 1; i <= id; i++) {
+        m->uf_parent[i] = i;
+    }
+    if (id > m->mark_connected) {
+        m->mark_connected = id;
+    }
+}
+
+// 修改时用的查找, 顺带做路径减半
+static int uf_find(Map* m, int id) {
+    int* parent = m->uf_parent;
+    while (parent[id] != id) {
+        parent[id] = parent[parent[id]];
+        id = parent[id];
+    }
+    return id;
+}
+
+/*
+    把每格的标号改写成所在区域的 id, 之后只有区域 id 还在用.
+    其余标号的 uf_parent 存 -1 - 下一个空闲标号, 串成 uf_free 链表
+*/
+static void uf_compact(Map* m) {
+    int len = m->width * m->height;
+    int i, max_used = 1, nlive = 0;
+    char* used = (char*)calloc(m->mark_connected + 1, sizeof(char));
+    for (i = 0; i < len; i++) {
+        int id = map_label(m, i);
+        if (id) {
+            int root = uf_find(m, id);
+            if (root != id) {
+                map_set_label(m, i, root);
+            }
+            used[root] = 1;
+            if (root > max_used) {
+                max_used = root;
+            }
+        }
+    }
+    m->uf_free = 0;
+    for (i = max_used; i >= 1; i--) {
+        if (used[i]) {
+            m->uf_parent[i] = i;
+            nlive++;
+        } else {
+            m->uf_parent[i] = -1 - m->uf_free;
+            m->uf_free = i;
+        }
+    }
+    free(used);
+    m->mark_connected = max_used;
+    if (m->connected_wide && max_used <= CONNECTED_NARROW_MAX) {
+        map_set_connected_wide(m, 0);
+    }
+    m->uf_compact_at = connected_compact_at(nlive);
+}
+
+static int new_label(Map* m) {
+    if (!m->uf_free && m->mark_connected >= m->uf_compact_at) {
+        uf_compact(m);
+    }
+    if (m->uf_free) {
+        int id = m->uf_free;
+        m->uf_free = -1 - m->uf_parent[id];
+        m->uf_parent[id] = id;
+        return id;
+    }
+    uf_reserve(m, m->mark_connected + 1);
+    return m->mark_connected;
+}
+
+int map_connected_id(Map* m, int pos) {
+    int id = map_label(m, pos);
+    if (m->uf_parent) {
+        while (m->uf_parent[id] != id) {
+            id = m->uf_parent[id];
+        }
+    }
+    return id;
+}
+
+void map_reset_connected(Map* m, int max_id) {
+    m->mark_connected = 0;
+    m->uf_free = 0;
+    m->uf_compact_at = connected_compact_at(max_id);
+    uf_reserve(m, max_id);
+}
+
+void map_set_connected_id(Map* m, int pos, int id) {
+    map_unshare(m);
+    uf_reserve(m, id);
+    if (m->uf_parent[id] < 0) {
+        // 手工用了空闲链表里的标号, 链表作废, 下次回收时重建
+        m->uf_parent[id] = id;
+        m->uf_free = 0;
+    }
+    map_set_label(m, pos, id);
+}
+
+/*
+    只在 [lo, hi) 这几行内做 flood fill, 用 connected 为 0 表示未访问,
+    不需要 visited 也不需要清空队列
+*/
+static void flood_mark(Map* m, int* queue, int pos, int id, int lo, int hi) {
+    int pop_i = 0, push_i = 0;
+    map_set_label(m, pos, id);
+    queue[push_i++] = pos;
+
+#define CHECK_POS(n) do { \
+    if (!map_label(m, n) && !map_blocked(m, n)) { \
+        map_set_label(m, n, id); \
+        queue[push_i++] = n; \
+    } \
+} while(0);
+    int cur, left;
+    while (pop_i < push_i) {
+        cur = queue[pop_i++];
+        left = cur % m->width;
+        if (left != 0) {
+            CHECK_POS(cur - 1);
+        }
+        if (left != m->width - 1) {
+            CHECK_POS(cur + 1);
+        }
+        if (cur - m->width >= lo) {
+            CHECK_POS(cur - m->width);
+        }
+        if (cur + m->width < hi) {
+            CHECK_POS(cur + m->width);
+        }
+    }
+#undef CHECK_POS
+}
+
+void map_mark_connected(Map* m) {
+    map_unshare(m);
+    connected_prepare(m);
+    // 重新标记时先回到 16 位, 区域数超出时再加宽
+    map_set_connected_wide(m, 0);
+    int len = m->width * m->height;
+    int i, connected_num = 0;
+    memset(m->connected, 0, len * map_label_size(m));
+    for (i = 0; i < len; i++) {
+        if (!map_label(m, i) && !map_blocked(m, i)) {
+            if (++connected_num > CONNECTED_NARROW_MAX) {
+                map_set_connected_wide(m, 1);
+            }
+            flood_mark(m, m->queue, i, connected_num, 0, len);
+        }
+    }
+    map_reset_connected(m, connected_num);
+}
+
+// 并行标记时每个线程负责连续的几行, 先在条带内各自从 1 编号
+struct mark_strip {
+    Map* m;
+    int lo; // 条带的第一个格子
+    int hi;
+    int nlabel;
+    int overflow; // 16 位存不下条带内的编号
+    int offset; // 条带内编号加上它才是全局编号
+    pthread_t tid;
+};
+
+static void* mark_strip_main(void* ud) {
+    struct mark_strip* st = (struct mark_strip*)ud;
+    Map* m = st->m;
+    size_t size = map_label_size(m);
+    int i;
+    st->nlabel = 0;
+    st->overflow = 0;
+    memset((char*)m->connected + st->lo * size, 0, (st->hi - st->lo) * size);
+    for (i = st->lo; i < st->hi; i++) {
+        if (!map_label(m, i) && !map_blocked(m, i)) {
+            if (st->nlabel == CONNECTED_NARROW_MAX && !m->connected_wide) {
+                st->overflow = 1;
+                return NULL;
+            }
+            // 条带内的 BFS 只会用到队列中对应这段的空间
+            flood_mark(m, m->queue + st->lo, i, ++st->nlabel, st->lo, st->hi);
+        }
+    }
+    return NULL;
+}
+
+static int label_find(int* parent, int id) {
+    while (parent[id] != id) {
+        parent[id] = parent[parent[id]];
+        id = parent[id];
+    }
+    return id;
+}
+
+void map_mark_connected_parallel(Map* m, int nthreads) {
+    map_unshare(m);
+    int w = m->width;
+    int i, k, x;
+    if (nthreads > m->height) {
+        nthreads = m->height;
+    }
+    if (nthreads <= 1) {
+        map_mark_connected(m);
+        return;
+    }
+    connected_prepare(m);
+    map_set_connected_wide(m, 0);
+    struct mark_strip* strips = (struct mark_strip*)calloc(nthreads, sizeof(struct mark_strip));
+    for (k = 0; k < nthreads; k++) {
+        strips[k].m = m;
+        strips[k].lo = m->height * k / nthreads * w;
+        strips[k].hi = m->height * (k + 1) / nthreads * w;
+    }
+    for (k = 1; k < nthreads; k++) {
+        pthread_create(&strips[k].tid, NULL, mark_strip_main, &strips[k]);
+    }
+    mark_strip_main(&strips[0]);
+    int overflow = strips[0].overflow;
+    for (k = 1; k < nthreads; k++) {
+        pthread_join(strips[k].tid, NULL);
+        overflow |= strips[k].overflow;
+    }
+    if (overflow) {
+        // 极少见, 加宽后整张图重来一遍
+        map_set_connected_wide(m, 1);
+        for (k = 1; k < nthreads; k++) {
+            pthread_create(&strips[k].tid, NULL, mark_strip_main, &strips[k]);
+        }
+        mark_strip_main(&strips[0]);
+        for (k = 1; k < nthreads; k++) {
+            pthread_join(strips[k].tid, NULL);
+        }
+    }
+
+    int total = 0;
+    for (k = 0; k < nthreads; k++) {
+        strips[k].offset = total;
+        total += strips[k].nlabel;
+    }
+    // 最终编号不超过 total, 重新编号前先保证放得下
+    if (total > CONNECTED_NARROW_MAX) {
+        map_set_connected_wide(m, 1);
+    }
+    // 合并条带边界上下相邻的编号
+    int* parent = (int*)malloc((total + 1) * sizeof(int));
+    for (i = 0; i <= total; i++) {
+        parent[i] = i;
+    }
+    for (k = 1; k < nthreads; k++) {
+        int lo = strips[k].lo;
+        for (x = 0; x < w; x++) {
+            int up = map_label(m, lo - w + x), down = map_label(m, lo + x);
+            if (up && down) {
+                int a = label_find(parent, up + strips[k - 1].offset);
+                int b = label_find(parent, down + strips[k].offset);
+                if (a != b) {
+                    parent[a > b ? a : b] = a < b ? a : b;
+                }
+            }
+        }
+    }
+    // 按格子顺序给每个区域编号, 跟单线程 flood fill 的结果完全一致
+    int* rank = (int*)calloc(total + 1, sizeof(int));
+    int connected_num = 0;
+    for (k = 0; k < nthreads; k++) {
+        for (i = strips[k].lo; i < strips[k].hi; i++) {
+            int id = map_label(m, i);
+            if (id) {
+                int root = label_find(parent, id + strips[k].offset);
+                if (!rank[root]) {
+                    rank[root] = ++connected_num;
+                }
+                map_set_label(m, i, rank[root]);
+            }
+        }
+    }
+    free(rank);
+    free(parent);
+    free(strips);
+    map_reset_connected(m, connected_num);
+}
+
+// 4 邻域中可走的格子
+static int walkable_neighbors(Map* m, int pos, int* out) {
+    int n = 0, x = pos % m->width;
+    if (x != 0 && !map_blocked(m, pos - 1)) {
+        out[n++] = pos - 1;
+    }
+    if (x != m->width - 1 && !map_blocked(m, pos + 1)) {
+        out[n++] = pos + 1;
+    }
+    if (pos >= m->width && !map_blocked(m, pos - m->width)) {
+        out[n++] = pos - m->width;
+    }
+    if (pos < m->width * (m->height - 1) && !map_blocked(m, pos + m->width)) {
+        out[n++] = pos + m->width;
+    }
+    return n;
+}
+
+static inline int in_area(Map* m, int pos, int root) {
+    int id = map_label(m, pos);
+    return id == root || uf_find(m, id) == root;
+}
+
+/*
+    seeds 都在区域 root 里, 从它们同时做 BFS, visited 记录格子属于哪一路(下标 + 1).
+    两路相遇就合并成一路, 只剩一路时结束; 某一路先走完说明它被隔开了,
+    这一块换成新标号写进 changed. 返回新标号的个数
+*/
+static int split_search(Map* m, int root, const int* seeds, int nseed, int* changed) {
+    int* queue = m->queue;
+    char* visited = m->visited;
+    int owner[4], pending[4];
+    int pop_i = 0, push_i = 0, alive = nseed, nchanged = 0;
+    int i, k, n;
+    int next[4];
+    for (k = 0; k < nseed; k++) {
+        owner[k] = k;
+        pending[k] = 1;
+        visited[seeds[k]] = k + 1;
+        queue[push_i++] = seeds[k];
+    }
+    while (alive > 1 && pop_i < push_i) {
+        int cur = queue[pop_i++];
+        int f = visited[cur] - 1;
+        while (owner[f] != f) {
+            f = owner[f];
+        }
+        pending[f]--;
+        n = walkable_neighbors(m, cur, next);
+        for (i = 0; i < n; i++) {
+            int pos = next[i];
+            if (!visited[pos]) {
+                if (in_area(m, pos, root)) {
+                    visited[pos] = f + 1;
+                    queue[push_i++] = pos;
+                    pending[f]++;
+                }
+                continue;
+            }
+            int g = visited[pos] - 1;
+            while (owner[g] != g) {
+                g = owner[g];
+            }
+            if (g != f) {
+                owner[g] = f;
+                pending[f] += pending[g];
+                alive--;
+            }
+        }
+        if (pending[f] == 0 && alive > 1) {
+            int label = new_label(m);
+            for (k = 0; k < push_i; k++) {
+                int g = visited[queue[k]] - 1;
+                while (owner[g] != g) {
+                    g = owner[g];
+                }
+                if (g == f) {
+                    map_set_label(m, queue[k], label);
+                }
+            }
+            changed[nchanged++] = label;
+            alive--;
+        }
+    }
+    for (i = 0; i < push_i; i++) {
+        visited[queue[i]] = 0;
+    }
+    return nchanged;
+}
+
+int map_remark_add_block(Map* m, int pos, int* changed) {
+    map_unshare(m);
+    connected_prepare(m);
+    // 与全量标记一致, 阻挡格的标号是 0
+    map_set_label(m, pos, 0);
+    int next[4], ids[4], group[4];
+    int n = walkable_neighbors(m, pos, next);
+    int i, k, nchanged = 0;
+    for (i = 0; i < n; i++) {
+        ids[i] = uf_find(m, map_label(m, next[i]));
+    }
+    // 同一区域的邻居不止一个时, 才可能被这个格子分成几块
+    for (i = 0; i < n; i++) {
+        int id = ids[i], ngroup = 0;
+        for (k = 0; k < i && ids[k] != id; k++);
+        if (id <= 0 || k < i) {
+            continue;
+        }
+        for (k = i; k < n; k++) {
+            if (ids[k] == id) {
+                group[ngroup++] = next[k];
+            }
+        }
+        if (ngroup < 2) {
+            continue;
+        }
+        int nsplit = split_search(m, id, group, ngroup, changed + nchanged + 1);
+        if (nsplit > 0) {
+            changed[nchanged] = id;
+            nchanged += nsplit + 1;
+        }
+    }
+    return nchanged;
+}
+
+int map_remark_clear_block(Map* m, int pos, int* changed) {
+    map_unshare(m);
+    int next[4];
+    int n = walkable_neighbors(m, pos, next);
+    int i, k, target = 0, nchanged = 0;
+    for (i = 0; i < n; i++) {
+        int id = uf_find(m, map_label(m, next[i]));
+        if (id <= 0) {
+            continue;
+        }
+        for (k = 0; k < nchanged && changed[k] != id; k++);
+        if (k == nchanged) {
+            changed[nchanged++] = id;
+        }
+        if (target == 0 || id < target) {
+            target = id;
+        }
+    }
+    if (nchanged == 0) {
+        // 四周没有可走的格子, 自成一个新区域
+        changed[0] = new_label(m);
+        map_set_label(m, pos, changed[0]);
+        return 1;
+    }
+    // 几个区域连到了一起, 在并查集上统一挂到最小的 id 下
+    for (i = 0; i < nchanged; i++) {
+        m->uf_parent[changed[i]] = target;
+    }
+    map_set_label(m, pos, target);
+    return nchanged > 1 ? nchanged : 0;
+}
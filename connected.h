@@ -0,0 +1,45 @@
+#ifndef __CONNECTED_H__
+#define __CONNECTED_H__ 0
+
+#include "map.h"
+
+/*
+    连通区域维护:
+    m->connected 存每个格子的原始标号, 标号之间用并查集合并, 对外的区域 id 是并查集的根.
+    去掉阻挡时把四周的区域在并查集上合并, 不改格子;
+    加阻挡时从四周的格子同时做 BFS, 几路相遇就没有分裂, 某一路先走完就说明它被分了出去,
+    只给这一块(也是最小的一块)换新标号
+*/
+
+/*
+    分裂时总是分配新标号, 合并后被并入的标号还留在格子里.
+    空闲标号用完且最大标号到了 connected_compact_at(区域数) 时, 把格子统一改写成区域 id,
+    没有格子再用的标号串进 uf_free 链表从小到大重用. 区域 id 不变, 标号数与区域数同阶
+*/
+static inline int connected_compact_at(int nareas) {
+    return nareas * 2 + 1024;
+}
+
+// 全量标记, 之后每个区域一个标号, 区域 id 从 1 开始连续编号
+void map_mark_connected(Map* m);
+/*
+    多线程全量标记: 按行切成 nthreads 个条带各自标记, 再用并查集合并条带边界,
+    最后按格子顺序重新编号, 得到的区域 id 与 map_mark_connected 完全相同
+*/
+void map_mark_connected_parallel(Map* m, int nthreads);
+// 格子所在区域的 id, 只读, 可以在多个线程里同时调用
+int map_connected_id(Map* m, int pos);
+// connected 中已经是 1 ~ max_id 的区域 id 时, 重建并查集
+void map_reset_connected(Map* m, int max_id);
+// 直接指定格子的区域 id
+void map_set_connected_id(Map* m, int pos, int id);
+
+/*
+    格子变成阻挡/可走后增量更新连通区域, 格子本身的阻挡状态由调用方设置.
+    changed 至少能放 4 个 id, 返回 id 发生变化的区域个数:
+    分裂时是原区域和新分出的区域, 合并时是参与合并的所有区域(保留最小的 id)
+*/
+int map_remark_add_block(Map* m, int pos, int* changed);
+int map_remark_clear_block(Map* m, int pos, int* changed);
+
+#endif /* __CONNECTED_H__ */
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dheap.h"
+
+#define CHECK_MALLOC(X) { \
+        if((X)==NULL) { \
+            fprintf(stderr, \
+                "dheap.c: Error allocating memory\n"); \
+            exit(1); \
+        }; }
+
+#define PARENT(i) (((i) - 1) / DHEAP_ARITY)
+#define FIRST_CHILD(i) ((i) * DHEAP_ARITY + 1)
+
+static inline void
+place(struct dheap *H, int slot, struct node_data *d)
+{
+    H->nodes[slot] = d;
+    H->index[d->pos] = slot + 1;
+}
+
+static void
+sift_up(struct dheap *H, int slot)
+{
+    struct node_data *d = H->nodes[slot];
+    while (slot > 0) {
+        int parent = PARENT(slot);
+        if ((H->compr)(H->nodes[parent], d) <= 0) {
+            break;
+        }
+        place(H, slot, H->nodes[parent]);
+        slot = parent;
+    }
+    place(H, slot, d);
+}
+
+static void
+sift_down(struct dheap *H, int slot)
+{
+    struct node_data *d = H->nodes[slot];
+    int i, child, best;
+    for (;;) {
+        child = FIRST_CHILD(slot);
+        if (child >= H->size) {
+            break;
+        }
+        best = child;
+        for (i = child + 1; i < child + DHEAP_ARITY && i < H->size; i++) {
+            if ((H->compr)(H->nodes[best], H->nodes[i]) > 0) {
+                best = i;
+            }
+        }
+        if ((H->compr)(d, H->nodes[best]) <= 0) {
+            break;
+        }
+        place(H, slot, H->nodes[best]);
+        slot = best;
+    }
+    place(H, slot, d);
+}
+
+void
+dheap_init(struct dheap *H)
+{
+    H->nodes = NULL;
+    H->index = NULL;
+    H->size = 0;
+    H->cap = 0;
+    H->compr = NULL;
+}
+
+void
+dheap_reset(struct dheap *H, int *index, int (*compr)(struct node_data *, struct node_data *))
+{
+    H->index = index;
+    H->size = 0;
+    H->compr = compr;
+}
+
+void
+dheap_insert(struct dheap *H, struct node_data *d)
+{
+    if (H->size == H->cap) {
+        H->cap = H->cap ? H->cap * 2 : 1024;
+        H->nodes = (struct node_data **)realloc(H->nodes, H->cap * sizeof(struct node_data *));
+        CHECK_MALLOC(H->nodes);
+    }
+    H->nodes[H->size++] = d;
+    sift_up(H, H->size - 1);
+}
+
+struct node_data *
+dheap_pop(struct dheap *H)
+{
+    struct node_data *ret;
+    if (H->size == 0) {
+        return NULL;
+    }
+    ret = H->nodes[0];
+    H->index[ret->pos] = 0;
+    if (--H->size > 0) {
+        H->nodes[0] = H->nodes[H->size];
+        sift_down(H, 0);
+    }
+    return ret;
+}
+
+void
+dheap_decrease(struct dheap *H, struct node_data *d)
+{
+    sift_up(H, H->index[d->pos] - 1);
+}
+
+void
+dheap_destroy(struct dheap *H)
+{
+    free(H->nodes);
+    H->nodes = NULL;
+    H->size = 0;
+    H->cap = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef __DHEAP_H__
+#define __DHEAP_H__ 0
+
+#include "fibheap.h"
+
+#define DHEAP_ARITY 4
+
+/*
+    数组实现的4叉堆, index 按格子记录节点在堆中的槽位(slot + 1),
+    0 表示不在堆中, 借用 map 的 open_set_map 作为存储
+*/
+struct dheap {
+    struct node_data **nodes;
+    int *index;
+    int size;
+    int cap;
+    int (*compr) (struct node_data *, struct node_data *);
+};
+
+void
+dheap_init(struct dheap *H);
+
+void
+dheap_reset(struct dheap *H, int *index, int (*compr)(struct node_data *, struct node_data *));
+
+void
+dheap_insert(struct dheap *H, struct node_data *d);
+
+struct node_data *
+dheap_pop(struct dheap *H);
+
+void
+dheap_decrease(struct dheap *H, struct node_data *d);
+
+void
+dheap_destroy(struct dheap *H);
+
+#endif /* __DHEAP_H__ */
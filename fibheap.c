@@ -38,13 +38,14 @@ exchange_right_node(struct heap_node *a, struct heap_node *b)
 }
 
 struct heap *
-fibheap_init(int max, int (*compr)(struct node_data *, struct node_data *))
+fibheap_init(struct arena *a, int max, int (*compr)(struct node_data *, struct node_data *))
 {
-    struct heap *H = (struct heap *)malloc(sizeof(struct heap));
+    struct heap *H = (struct heap *)arena_alloc(a, sizeof(struct heap));
     CHECK_MALLOC(H);
     CHECK_INPUT(max > 0, "fibheap_init: max has to be positive");
+    H->arena = a;
     H->the_one = NULL;
-    H->cons_array = (struct heap_node **)malloc((LOG2(max)+2) *  sizeof(struct heap_node *));
+    H->cons_array = (struct heap_node **)arena_alloc(a, (int)(LOG2(max)+2) *  sizeof(struct heap_node *));
     CHECK_MALLOC(H->cons_array);
     H->node_num = 0;
     H->max = max;
@@ -55,9 +56,9 @@ fibheap_init(int max, int (*compr)(struct node_data *, struct node_data *))
 struct heap_node *
 fibheap_insert(struct heap *H, struct node_data *d)
 {
-    struct heap_node *node = (struct heap_node *)malloc(sizeof(struct heap_node));
-    CHECK_MALLOC(node);
     CHECK_INPUT(H != NULL, "fibheap_insert: H==NULL");
+    struct heap_node *node = (struct heap_node *)arena_alloc(H->arena, sizeof(struct heap_node));
+    CHECK_MALLOC(node);
     CHECK_INPUT(H->node_num<H->max, "fibheap_insert: Fibonacci Heap Overflow");
 
     node->data = d;
@@ -115,7 +116,6 @@ fibheap_consolidate(struct heap *H)
     struct heap_node *x, *w, *y, *temp, *new_one;
 
     if (H->node_num == 0) {
-        free(H->the_one);
         H->the_one = NULL;
         return;
     }
@@ -153,7 +153,6 @@ fibheap_consolidate(struct heap *H)
 
     H->the_one->left->right = H->the_one->right;
     H->the_one->right->left = H->the_one->left;
-    free(H->the_one);
     H->the_one = new_one;
 }
 
@@ -217,81 +216,20 @@ fibheap_casc_cut(struct heap *H, struct heap_node *y)
     return fibheap_casc_cut(H, z);
 }
 
-void
-fibheap_increase(struct heap *H, struct heap_node *node)
-{
-    struct heap_node *y;
-    CHECK_INPUT(H != NULL, "fibheap_increase: H==NULL");
-    CHECK_INPUT(node != NULL, "fibheap_increase: node==NULL");
-
-    y = node->parent;
-    if (y != NULL && ((H->compr)(y->data, node->data) > 0)) {
-        fibheap_cut(H, node, y);
-        fibheap_casc_cut(H, y);
-    }
-    if ((H->compr)(H->the_one->data, node->data) > 0) {
-        H->the_one = node;
-    }
-}
-
+/* node 的值变小之后调用: 比父节点小就剪到根链表上, 比 the_one 小就成为新的 the_one */
 void
 fibheap_decrease(struct heap *H, struct heap_node *node)
 {
-    int i;
     struct heap_node *y;
     CHECK_INPUT(H != NULL, "fibheap_decrease: H==NULL");
     CHECK_INPUT(node != NULL, "fibheap_decrease: node==NULL");
 
-    /* concat node's childs with the root list */
-    for (i = 0; i < node->degree; i++) {
-        node->child->parent = NULL;
-        node->child = node->child->right;
-    }
-    if (node->child != NULL) {
-        exchange_right_node(H->the_one, node->child);
-    }
-    node->child = NULL;
-    node->degree = 0;
-
-    /* cut the node */
     y = node->parent;
-    if (y != NULL) {
+    if (y != NULL && ((H->compr)(y->data, node->data) > 0)) {
         fibheap_cut(H, node, y);
         fibheap_casc_cut(H, y);
-    } else if (H->the_one == node) { /* find then new the_one */
-        y = node->right;
-        while (y != node) {
-            if ((H->compr)(node->data, y->data) > 0) {
-                H->the_one = y;
-            }
-            y = y->right;
-        }
     }
-}
-
-static void
-fibheap_destroy_rec(struct heap_node *node)
-{
-    struct heap_node *start = node;
-
-    if (node == NULL) {
-        return;
+    if ((H->compr)(H->the_one->data, node->data) > 0) {
+        H->the_one = node;
     }
-
-    do {
-        fibheap_destroy_rec(node->child);
-        node = node->right;
-        free(node->left->data);
-        free(node->left);
-    } while (node != start);
-}
-
-void
-fibheap_destroy(struct heap *H)
-{
-    CHECK_INPUT(H != NULL, "fibheap_destroy: H==NULL");
-
-    fibheap_destroy_rec(H->the_one);
-    free(H->cons_array);
-    free(H);
 }
@@ -1,6 +1,8 @@
 #ifndef __FIB_HEAP_H__
 #define __FIB_HEAP_H__ 0
 
+#include "arena.h"
+
 struct node_data
 {
     int pos;
@@ -20,6 +22,7 @@ struct heap_node {
 };
 
 struct heap {
+    struct arena *arena;
     struct heap_node *the_one;
     struct heap_node **cons_array;
     int (*compr) (struct node_data *, struct node_data *);
@@ -28,7 +31,7 @@ struct heap {
 };
 
 struct heap *
-fibheap_init(int max, int (*compr)(struct node_data *, struct node_data *));
+fibheap_init(struct arena *a, int max, int (*compr)(struct node_data *, struct node_data *));
 
 struct heap_node *
 fibheap_insert(struct heap *H, struct node_data *d);
@@ -39,7 +42,4 @@ fibheap_pop(struct heap *H);
 void
 fibheap_decrease(struct heap *H, struct heap_node *node);
 
-void
-fibheap_destroy(struct heap *H);
-
 #endif /* __FIB_HEAP_H__ */
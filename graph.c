@@ -0,0 +1,227 @@
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fibheap.h"
+#include "graph.h"
+
+static inline int distance_cost(float x1, float y1, float x2, float y2) {
+    float dx = x1 - x2, dy = y1 - y2;
+    return (int)(sqrtf(dx * dx + dy * dy) * GRAPH_COST_SCALE + 0.5f);
+}
+
+struct graph* graph_new(void) {
+    struct graph* g = (struct graph*)calloc(1, sizeof(struct graph));
+    arena_init(&g->arena);
+    dheap_init(&g->heap);
+    return g;
+}
+
+void graph_free(struct graph* g) {
+    int i;
+    for (i = 0; i < g->n; i++) {
+        free(g->nodes[i].edges);
+    }
+    free(g->nodes);
+    free(g->free_ids);
+    free(g->index);
+    free(g->comefrom);
+    free(g->gen);
+    free(g->path);
+    arena_destroy(&g->arena);
+    dheap_destroy(&g->heap);
+    free(g);
+}
+
+size_t graph_memory(const struct graph* g) {
+    size_t bytes = sizeof(struct graph);
+    int i;
+    if (g->cap) {
+        bytes += g->cap * (sizeof(struct graph_node) + 2 * sizeof(int)) +
+                 (g->cap + 2) * (2 * sizeof(int) + sizeof(unsigned int));
+    }
+    for (i = 0; i < g->n; i++) {
+        bytes += g->nodes[i].cap * sizeof(struct graph_edge);
+    }
+    return bytes + arena_memory(&g->arena) + g->heap.cap * sizeof(struct node_data*);
+}
+
+static void grow(struct graph* g) {
+    int cap = g->cap ? g->cap * 2 : 64;
+    g->nodes = (struct graph_node*)realloc(g->nodes, cap * sizeof(struct graph_node));
+    g->free_ids = (int*)realloc(g->free_ids, cap * sizeof(int));
+    g->index = (int*)realloc(g->index, (cap + 2) * sizeof(int));
+    g->comefrom = (int*)realloc(g->comefrom, (cap + 2) * sizeof(int));
+    g->gen = (unsigned int*)realloc(g->gen, (cap + 2) * sizeof(unsigned int));
+    g->path = (int*)realloc(g->path, cap * sizeof(int));
+    memset(g->gen, 0, (cap + 2) * sizeof(unsigned int));
+    g->search_gen = 0;
+    g->cap = cap;
+}
+
+int graph_add_node(struct graph* g, float x, float y, int area) {
+    int id;
+    if (g->nfree > 0) {
+        id = g->free_ids[--g->nfree];
+    } else {
+        if (g->n == g->cap) {
+            grow(g);
+        }
+        id = g->n++;
+        g->nodes[id].edges = NULL;
+        g->nodes[id].cap = 0;
+    }
+    struct graph_node* node = &g->nodes[id];
+    node->x = x;
+    node->y = y;
+    node->area = area;
+    node->used = 1;
+    node->disabled = 0;
+    node->nedge = 0;
+    return id;
+}
+
+int graph_valid(struct graph* g, int id) {
+    return id >= 0 && id < g->n && g->nodes[id].used;
+}
+
+static void remove_edge(struct graph_node* node, int to) {
+    int i;
+    for (i = 0; i < node->nedge; i++) {
+        if (node->edges[i].to == to) {
+            node->edges[i] = node->edges[--node->nedge];
+            return;
+        }
+    }
+}
+
+static void set_edge(struct graph_node* node, int to, int cost) {
+    int i;
+    for (i = 0; i < node->nedge; i++) {
+        if (node->edges[i].to == to) {
+            node->edges[i].cost = cost;
+            return;
+        }
+    }
+    if (node->nedge == node->cap) {
+        node->cap = node->cap ? node->cap * 2 : 4;
+        node->edges = (struct graph_edge*)realloc(node->edges, node->cap * sizeof(struct graph_edge));
+    }
+    node->edges[node->nedge].to = to;
+    node->edges[node->nedge].cost = cost;
+    node->nedge++;
+}
+
+void graph_del_node(struct graph* g, int id) {
+    struct graph_node* node = &g->nodes[id];
+    int i;
+    for (i = 0; i < node->nedge; i++) {
+        remove_edge(&g->nodes[node->edges[i].to], id);
+    }
+    node->nedge = 0;
+    node->used = 0;
+    g->free_ids[g->nfree++] = id;
+}
+
+void graph_connect(struct graph* g, int a, int b, float weight) {
+    int cost = (int)(weight * GRAPH_COST_SCALE + 0.5f);
+    set_edge(&g->nodes[a], b, cost);
+    set_edge(&g->nodes[b], a, cost);
+}
+
+void graph_disconnect(struct graph* g, int a, int b) {
+    remove_edge(&g->nodes[a], b);
+    remove_edge(&g->nodes[b], a);
+}
+
+static inline int compare(struct node_data* old, struct node_data* new) {
+    if (new->f_value < old->f_value) {
+        return 1;
+    } else {
+        return -1;
+    }
+}
+
+static void relax(struct graph* g, int from, int id, int g_value, int h_value) {
+    if (g->gen[id] == g->search_gen + 1) {
+        return;
+    }
+    if (g->gen[id] != g->search_gen) {
+        g->gen[id] = g->search_gen;
+        g->index[id] = 0;
+    }
+    if (!g->index[id]) {
+        struct node_data* node = (struct node_data*)arena_alloc(&g->arena, sizeof(struct node_data));
+        node->pos = id;
+        node->g_value = g_value;
+        node->f_value = g_value + h_value;
+        node->dir = 0;
+        g->comefrom[id] = from;
+        dheap_insert(&g->heap, node);
+    } else {
+        struct node_data* node = g->heap.nodes[g->index[id] - 1];
+        if (node->g_value > g_value) {
+            node->f_value -= node->g_value - g_value;
+            node->g_value = g_value;
+            g->comefrom[id] = from;
+            dheap_decrease(&g->heap, node);
+        }
+    }
+}
+
+int graph_find_path(struct graph* g, float sx, float sy, int src_area,
+                    float dx, float dy, int dst_area) {
+    if (g->cap == 0) {
+        return -1;
+    }
+    int src = g->cap, dst = g->cap + 1;
+    int i;
+    g->search_gen += 2;
+    if (g->search_gen >= UINT_MAX - 1) {
+        memset(g->gen, 0, (g->cap + 2) * sizeof(unsigned int));
+        g->search_gen = 2;
+    }
+    arena_reset(&g->arena);
+    dheap_reset(&g->heap, g->index, compare);
+    relax(g, -1, src, 0, distance_cost(sx, sy, dx, dy));
+
+    struct node_data* cur;
+    while ((cur = dheap_pop(&g->heap))) {
+        int id = cur->pos;
+        g->gen[id] = g->search_gen + 1;
+        if (id == dst) {
+            int n = 0;
+            for (id = g->comefrom[dst]; id != src; id = g->comefrom[id]) {
+                n++;
+            }
+            g->path_len = n;
+            for (id = g->comefrom[dst]; id != src; id = g->comefrom[id]) {
+                g->path[--n] = id;
+            }
+            return g->path_len;
+        }
+        if (id == src) {
+            for (i = 0; i < g->n; i++) {
+                struct graph_node* node = &g->nodes[i];
+                if (node->used && !node->disabled && node->area == src_area) {
+                    relax(g, src, i, distance_cost(sx, sy, node->x, node->y),
+                          distance_cost(node->x, node->y, dx, dy));
+                }
+            }
+            continue;
+        }
+        struct graph_node* node = &g->nodes[id];
+        for (i = 0; i < node->nedge; i++) {
+            struct graph_edge* e = &node->edges[i];
+            struct graph_node* next = &g->nodes[e->to];
+            if (!next->disabled) {
+                relax(g, id, e->to, cur->g_value + e->cost, distance_cost(next->x, next->y, dx, dy));
+            }
+        }
+        if (node->area == dst_area) {
+            relax(g, id, dst, cur->g_value + distance_cost(node->x, node->y, dx, dy), 0);
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,64 @@
+#ifndef __GRAPH_H__
+#define __GRAPH_H__ 0
+
+#include "arena.h"
+#include "dheap.h"
+
+// 边权按浮点距离乘以这个系数取整保存, 以便复用整型的堆节点
+#define GRAPH_COST_SCALE 1000
+
+struct graph_edge {
+    int to;
+    int cost;
+};
+
+struct graph_node {
+    float x, y;
+    int area; // 所在的连通区域
+    char used;
+    char disabled; // 连接点被阻挡时不可通过
+    int nedge;
+    int cap;
+    struct graph_edge* edges;
+};
+
+/*
+    传送点连接点构成的图, 节点 id 由 graph_add_node 分配, 删除后可复用.
+    寻路时起点和终点作为两个临时节点, 分别连到所在区域的所有可用连接点
+*/
+struct graph {
+    int n; // 已用过的最大 id + 1
+    int cap;
+    struct graph_node* nodes;
+    int* free_ids;
+    int nfree;
+
+    // 寻路用的临时状态, 下标为节点 id, cap 和 cap + 1 分别是起点和终点
+    int* index;
+    int* comefrom;
+    unsigned int* gen;
+    unsigned int search_gen;
+    struct arena arena;
+    struct dheap heap;
+    int* path;
+    int path_len;
+};
+
+struct graph* graph_new(void);
+void graph_free(struct graph* g);
+size_t graph_memory(const struct graph* g);
+int graph_add_node(struct graph* g, float x, float y, int area);
+void graph_del_node(struct graph* g, int id);
+int graph_valid(struct graph* g, int id);
+// 双向连接, 已经相连时更新边权
+void graph_connect(struct graph* g, int a, int b, float weight);
+void graph_disconnect(struct graph* g, int a, int b);
+
+/*
+    从 (sx, sy) 出发经连接点到 (dx, dy) 的最短路, 找到时返回经过的连接点数,
+    连接点 id 按顺序存在 g->path 中, 找不到返回 -1
+*/
+int graph_find_path(struct graph* g, float sx, float sy, int src_area,
+                    float dx, float dy, int dst_area);
+
+#endif /* __GRAPH_H__ */
@@ -0,0 +1,486 @@
+#include "connected.h"
+#include "fibheap.h"
+#include "hpa.h"
+#include "jps.h"
+#include "openset.h"
+#include "path.h"
+
+#define STRAIGHT_COST 5
+#define DIAGONAL_COST 7
+
+static inline int cluster_of(Map* m, struct hpa* h, int pos) {
+    int x = pos % m->width, y = pos / m->width;
+    return (y / h->size) * h->cw + x / h->size;
+}
+
+static void cluster_rect(Map* m, struct hpa* h, int c, int* x0, int* y0, int* x1, int* y1) {
+    *x0 = (c % h->cw) * h->size;
+    *y0 = (c / h->cw) * h->size;
+    *x1 = *x0 + h->size - 1;
+    *y1 = *y0 + h->size - 1;
+    if (*x1 >= m->width) {
+        *x1 = m->width - 1;
+    }
+    if (*y1 >= m->height) {
+        *y1 = m->height - 1;
+    }
+}
+
+static void scratch_reserve(struct hpa_scratch* sc, int cells) {
+    if (cells <= sc->cap) {
+        return;
+    }
+    sc->cap = cells;
+    sc->dist = (int*)realloc(sc->dist, cells * sizeof(int));
+    sc->heap = (long long*)realloc(sc->heap, (cells * 8 + 1) * sizeof(long long));
+}
+
+static int* scratch_ints(struct hpa_scratch* sc, int n) {
+    if (n > sc->ints_cap) {
+        sc->ints_cap = n;
+        sc->ints = (int*)realloc(sc->ints, n * sizeof(int));
+    }
+    return sc->ints;
+}
+
+void hpa_scratch_free(struct hpa_scratch* sc) {
+    free(sc->dist);
+    free(sc->heap);
+    free(sc->ints);
+    sc->dist = NULL;
+    sc->heap = NULL;
+    sc->ints = NULL;
+    sc->cap = 0;
+    sc->ints_cap = 0;
+}
+
+size_t hpa_scratch_memory(const struct hpa_scratch* sc) {
+    return sc->cap * sizeof(int) + (sc->cap ? (sc->cap * 8 + 1) * sizeof(long long) : 0) +
+           sc->ints_cap * sizeof(int);
+}
+
+// 小根堆, 元素为 (距离 << 32) | 格子
+static void heap_push(long long* heap, int* n, long long v) {
+    int i = (*n)++;
+    while (i > 0) {
+        int p = (i - 1) / 2;
+        if (heap[p] <= v) {
+            break;
+        }
+        heap[i] = heap[p];
+        i = p;
+    }
+    heap[i] = v;
+}
+
+static long long heap_pop(long long* heap, int* n) {
+    long long top = heap[0];
+    long long v = heap[--(*n)];
+    int i = 0;
+    for (;;) {
+        int c = i * 2 + 1;
+        if (c >= *n) {
+            break;
+        }
+        if (c + 1 < *n && heap[c + 1] < heap[c]) {
+            c++;
+        }
+        if (v <= heap[c]) {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = v;
+    return top;
+}
+
+static const int dir_dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int dir_dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+
+/*
+    在矩形 [x0, x1] x [y0, y1] 内从 src 出发做 Dijkstra, 移动规则与 JPS 一致(允许切角),
+    结果写入 sc->dist, 下标为矩形内的局部坐标, 不可达为 -1
+*/
+static void local_dijkstra(Map* m, struct hpa_scratch* sc, int x0, int y0, int x1, int y1, int src) {
+    int lw = x1 - x0 + 1, lh = y1 - y0 + 1;
+    int i, n = 0;
+    scratch_reserve(sc, lw * lh);
+    int* dist = sc->dist;
+    for (i = 0; i < lw * lh; i++) {
+        dist[i] = -1;
+    }
+    int cell = (src / m->width - y0) * lw + src % m->width - x0;
+    dist[cell] = 0;
+    heap_push(sc->heap, &n, cell);
+    while (n > 0) {
+        long long top = heap_pop(sc->heap, &n);
+        int d = top >> 32;
+        cell = top & 0xffffffff;
+        if (d > dist[cell]) {
+            continue;
+        }
+        int lx = cell % lw, ly = cell / lw;
+        int dir;
+        for (dir = 0; dir < 8; dir++) {
+            int nx = lx + dir_dx[dir], ny = ly + dir_dy[dir];
+            if (nx < 0 || ny < 0 || nx >= lw || ny >= lh) {
+                continue;
+            }
+            if (map_blocked(m, xy2pos(m, nx + x0, ny + y0))) {
+                continue;
+            }
+            int next = ny * lw + nx;
+            int nd = d + (dir % 2 ? DIAGONAL_COST : STRAIGHT_COST);
+            if (dist[next] < 0 || nd < dist[next]) {
+                dist[next] = nd;
+                heap_push(sc->heap, &n, ((long long)nd << 32) | next);
+            }
+        }
+    }
+}
+
+static void add_node(struct hpa_cluster* cl, int pos, int peer) {
+    if (cl->nnode >= cl->cap) {
+        cl->cap = cl->cap ? cl->cap * 2 : 8;
+        cl->pos = (int*)realloc(cl->pos, cl->cap * sizeof(int));
+        cl->peer = (int*)realloc(cl->peer, cl->cap * sizeof(int));
+    }
+    cl->pos[cl->nnode] = pos;
+    cl->peer[cl->nnode] = peer;
+    cl->nnode++;
+}
+
+static void add_entrance(Map* m, struct hpa_cluster* cl, int x, int y, int ox, int oy) {
+    add_node(cl, xy2pos(m, x, y), xy2pos(m, x + ox, y + oy));
+}
+
+/*
+    扫描一条簇边界, 第 i 个格子是 (ax + i * dx, ay + i * dy), 对面的格子再偏移 (ox, oy).
+    两侧从不同方向扫描同一条边界得到的入口位置相同, 所以两个簇的入口总是一一对应
+*/
+static void scan_border(Map* m, struct hpa_cluster* cl, int ax, int ay, int dx, int dy,
+                        int len, int ox, int oy) {
+    int i, run = -1;
+    for (i = 0; i <= len; i++) {
+        int open = 0;
+        if (i < len) {
+            int x = ax + i * dx, y = ay + i * dy;
+            open = !map_blocked(m, xy2pos(m, x, y)) && !map_blocked(m, xy2pos(m, x + ox, y + oy));
+        }
+        if (open && run < 0) {
+            run = i;
+        } else if (!open && run >= 0) {
+            int last = i - 1;
+            if (last - run + 1 >= HPA_ENTRANCE_SPLIT) {
+                add_entrance(m, cl, ax + run * dx, ay + run * dy, ox, oy);
+                add_entrance(m, cl, ax + last * dx, ay + last * dy, ox, oy);
+            } else {
+                int mid = (run + last) / 2;
+                add_entrance(m, cl, ax + mid * dx, ay + mid * dy, ox, oy);
+            }
+            run = -1;
+        }
+    }
+}
+
+static struct hpa_cluster* ensure_cluster(Map* m, struct hpa* h, int c) {
+    struct hpa_cluster* cl = &h->clusters[c];
+    if (cl->valid) {
+        return cl;
+    }
+    int x0, y0, x1, y1, i, j;
+    cluster_rect(m, h, c, &x0, &y0, &x1, &y1);
+    cl->nnode = 0;
+    if (y0 > 0) {
+        scan_border(m, cl, x0, y0, 1, 0, x1 - x0 + 1, 0, -1);
+    }
+    if (y1 < m->height - 1) {
+        scan_border(m, cl, x0, y1, 1, 0, x1 - x0 + 1, 0, 1);
+    }
+    if (x0 > 0) {
+        scan_border(m, cl, x0, y0, 0, 1, y1 - y0 + 1, -1, 0);
+    }
+    if (x1 < m->width - 1) {
+        scan_border(m, cl, x1, y0, 0, 1, y1 - y0 + 1, 1, 0);
+    }
+    free(cl->dist);
+    cl->dist = (int*)malloc(cl->nnode * cl->nnode * sizeof(int) + 1);
+    int lw = x1 - x0 + 1;
+    for (i = 0; i < cl->nnode; i++) {
+        local_dijkstra(m, &h->scratch, x0, y0, x1, y1, cl->pos[i]);
+        for (j = 0; j < cl->nnode; j++) {
+            int p = cl->pos[j];
+            cl->dist[i * cl->nnode + j] = h->scratch.dist[(p / m->width - y0) * lw + p % m->width - x0];
+        }
+    }
+    cl->valid = 1;
+    return cl;
+}
+
+void hpa_build(Map* m, int size) {
+    hpa_free(m);
+    struct hpa* h = (struct hpa*)calloc(1, sizeof(struct hpa));
+    h->size = size;
+    h->cw = (m->width + size - 1) / size;
+    h->ch = (m->height + size - 1) / size;
+    h->clusters = (struct hpa_cluster*)calloc(h->cw * h->ch, sizeof(struct hpa_cluster));
+    m->hpa = h;
+}
+
+void hpa_free(Map* m) {
+    struct hpa* h = m->hpa;
+    if (!h) {
+        return;
+    }
+    int i;
+    for (i = 0; i < h->cw * h->ch; i++) {
+        free(h->clusters[i].pos);
+        free(h->clusters[i].peer);
+        free(h->clusters[i].dist);
+    }
+    free(h->clusters);
+    hpa_scratch_free(&h->scratch);
+    free(h);
+    m->hpa = NULL;
+}
+
+size_t hpa_memory(Map* m) {
+    struct hpa* h = m->hpa;
+    if (!h) {
+        return 0;
+    }
+    size_t bytes = sizeof(struct hpa) + h->cw * h->ch * sizeof(struct hpa_cluster);
+    int i;
+    for (i = 0; i < h->cw * h->ch; i++) {
+        struct hpa_cluster* cl = &h->clusters[i];
+        bytes += cl->cap * 2 * sizeof(int);
+        if (cl->dist) {
+            bytes += cl->nnode * cl->nnode * sizeof(int) + 1;
+        }
+    }
+    return bytes + hpa_scratch_memory(&h->scratch);
+}
+
+// 格子落在簇的边上时, 共用这条边界的相邻簇入口也会变化
+void hpa_update(Map* m, int pos) {
+    struct hpa* h = m->hpa;
+    int x = pos % m->width, y = pos / m->width;
+    int cx = x / h->size, cy = y / h->size;
+    int c = cy * h->cw + cx;
+    h->clusters[c].valid = 0;
+    if (x % h->size == 0 && cx > 0) {
+        h->clusters[c - 1].valid = 0;
+    }
+    if ((x % h->size == h->size - 1) && cx < h->cw - 1) {
+        h->clusters[c + 1].valid = 0;
+    }
+    if (y % h->size == 0 && cy > 0) {
+        h->clusters[c - h->cw].valid = 0;
+    }
+    if ((y % h->size == h->size - 1) && cy < h->ch - 1) {
+        h->clusters[c + h->cw].valid = 0;
+    }
+}
+
+void hpa_invalidate_all(Map* m) {
+    struct hpa* h = m->hpa;
+    int i;
+    for (i = 0; i < h->cw * h->ch; i++) {
+        h->clusters[i].valid = 0;
+    }
+}
+
+void hpa_refresh(Map* m) {
+    struct hpa* h = m->hpa;
+    int i;
+    for (i = 0; i < h->cw * h->ch; i++) {
+        ensure_cluster(m, h, i);
+    }
+}
+
+static inline int compare(struct node_data* old, struct node_data* new) {
+    if (new->f_value < old->f_value) {
+        return 1;
+    } else {
+        return -1;
+    }
+}
+
+// 抽象图上的松弛, 用法同 jps.c 中的 put_in_open_set, 开放列表同样跟随 s->open_list
+static void relax(Map* m, SearchContext* s, int from, int pos, int g_value) {
+    unsigned int gen = s->gen[pos];
+    if (gen == s->search_gen + 1) {
+        return;
+    }
+    if (gen != s->search_gen) {
+        touch(s, pos);
+    }
+    struct node_data* node = open_set_find(s, pos);
+    if (!node) {
+        node = (struct node_data*)arena_alloc(&s->arena, sizeof(struct node_data));
+        node->pos = pos;
+        node->g_value = g_value;
+        node->f_value = g_value + dist(s->end, pos, m->width);
+        node->dir = NO_DIRECTION;
+        s->comefrom[pos] = from;
+        open_set_push(s->open_set, s, node);
+    } else if (node->g_value > g_value) {
+        node->f_value -= node->g_value - g_value;
+        node->g_value = g_value;
+        s->comefrom[pos] = from;
+        open_set_decrease(s->open_set, s, node);
+    }
+}
+
+// 起点或终点到所在簇各入口的距离, 写入 out
+static void endpoint_dist(Map* m, struct hpa* h, struct hpa_scratch* sc, int pos, int c, int* out) {
+    struct hpa_cluster* cl = &h->clusters[c];
+    int x0, y0, x1, y1, j;
+    cluster_rect(m, h, c, &x0, &y0, &x1, &y1);
+    local_dijkstra(m, sc, x0, y0, x1, y1, pos);
+    int lw = x1 - x0 + 1;
+    for (j = 0; j < cl->nnode; j++) {
+        int p = cl->pos[j];
+        out[j] = sc->dist[(p / m->width - y0) * lw + p % m->width - x0];
+    }
+}
+
+static int abstract_search(Map* m, SearchContext* s, int ec_id,
+                           const int* start_dist, const int* end_dist) {
+    struct hpa* h = m->hpa;
+    int len = m->width * m->height;
+    search_ctx_prepare(s);
+    s->search_gen += 2;
+    if (s->search_gen >= UINT_MAX - 1) {
+        memset(s->gen, 0, len * sizeof(unsigned int));
+        s->search_gen = 2;
+    }
+    s->expanded = 0;
+    arena_reset(&s->arena);
+    s->open_set = NULL;
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        dheap_reset(&s->open_heap, (int*)s->open_set_map, compare);
+    } else {
+        s->open_set = fibheap_init(&s->arena, len, compare);
+    }
+    relax(m, s, -1, s->start, 0);
+
+    struct node_data* node;
+    while ((node = open_set_pop(s->open_set, s))) {
+        int p = node->pos, g = node->g_value;
+        s->gen[p] = s->search_gen + 1;
+        s->expanded++;
+        if (p == s->end) {
+            return 1;
+        }
+        int c = cluster_of(m, h, p);
+        struct hpa_cluster* cl = ensure_cluster(m, h, c);
+        int i, j, row = -1;
+        for (j = 0; j < cl->nnode; j++) {
+            if (cl->pos[j] != p) {
+                continue;
+            }
+            if (row < 0) {
+                row = j;
+            }
+            relax(m, s, p, cl->peer[j], g + STRAIGHT_COST);
+        }
+        if (p == s->start) {
+            for (j = 0; j < cl->nnode; j++) {
+                if (start_dist[j] > 0) {
+                    relax(m, s, p, cl->pos[j], g + start_dist[j]);
+                }
+            }
+            continue;
+        }
+        if (row < 0) {
+            continue;
+        }
+        const int* d = cl->dist + row * cl->nnode;
+        for (i = 0; i < cl->nnode; i++) {
+            if (d[i] > 0) {
+                relax(m, s, p, cl->pos[i], g + d[i]);
+            }
+        }
+        if (c == ec_id && end_dist[row] >= 0) {
+            relax(m, s, p, s->end, g + end_dist[row]);
+        }
+    }
+    return 0;
+}
+
+static inline int adjacent(Map* m, int a, int b) {
+    int dx = a % m->width - b % m->width;
+    int dy = a / m->width - b / m->width;
+    return dx >= -1 && dx <= 1 && dy >= -1 && dy <= 1;
+}
+
+int hpa_find_path(Map* m, SearchContext* s) {
+    struct hpa* h = m->hpa;
+    int start = s->start, end = s->end;
+    // 与 jps_start 一样先看连通区域, 交给 JPS 直接返回找不到
+    if (m->mark_connected && (map_connected_id(m, start) != map_connected_id(m, end))) {
+        return 0;
+    }
+    int sc_id = cluster_of(m, h, start), ec_id = cluster_of(m, h, end);
+    int dcx = sc_id % h->cw - ec_id % h->cw;
+    int dcy = sc_id / h->cw - ec_id / h->cw;
+    if (dcx >= -1 && dcx <= 1 && dcy >= -1 && dcy <= 1) {
+        // 离得近时直接 JPS 更快
+        return 0;
+    }
+    if (!s->hpa_scratch) {
+        s->hpa_scratch = (struct hpa_scratch*)calloc(1, sizeof(struct hpa_scratch));
+    }
+    struct hpa_scratch* sc = s->hpa_scratch;
+    struct hpa_cluster* scl = ensure_cluster(m, h, sc_id);
+    struct hpa_cluster* ecl = ensure_cluster(m, h, ec_id);
+    int* start_dist = scratch_ints(sc, scl->nnode + ecl->nnode);
+    int* end_dist = start_dist + scl->nnode;
+    endpoint_dist(m, h, sc, start, sc_id, start_dist);
+    endpoint_dist(m, h, sc, end, ec_id, end_dist);
+    int found = abstract_search(m, s, ec_id, start_dist, end_dist);
+    if (!found) {
+        return 0;
+    }
+
+    // 抽象路径从终点回溯到起点, 先拷出来, 细化时 comefrom 会被覆盖
+    int n = 0, pos;
+    for (pos = end; pos != -1; pos = s->comefrom[pos]) {
+        n++;
+    }
+    int* nodes = scratch_ints(sc, n);
+    n = 0;
+    for (pos = end; pos != -1; pos = s->comefrom[pos]) {
+        nodes[n++] = pos;
+    }
+
+    int i, ok = 1;
+    int expanded = s->expanded;
+    s->ipath_len = 0;
+    for (i = 0; i < n - 1; i++) {
+        int to = nodes[i], from = nodes[i + 1];
+        if (adjacent(m, to, from)) {
+            push_pos_to_ipath(s, to);
+            continue;
+        }
+        s->start = from;
+        s->end = to;
+        int last = jps_find_path(m, s);
+        if (last < 0) {
+            ok = 0;
+            break;
+        }
+        expanded += s->expanded;
+        append_ipath(m, s, last);
+    }
+    s->expanded = expanded;
+    s->start = start;
+    s->end = end;
+    if (!ok) {
+        return 0;
+    }
+    push_pos_to_ipath(s, start);
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef __HPA_H__
+#define __HPA_H__ 0
+
+#include "map.h"
+
+#define HPA_CLUSTER_SIZE 64
+// 边界上连续可通过的格子数达到这个值时, 在两端各放一个入口, 否则只在中间放一个
+#define HPA_ENTRANCE_SPLIT 6
+
+/*
+    分层寻路(HPA*): 地图按 size x size 切成簇, 相邻簇的公共边界上取入口,
+    入口之间的簇内距离用 Dijkstra 求出. 寻路时先在入口构成的抽象图上做 A*,
+    再用 JPS 把相邻的抽象节点连起来.
+    簇的入口和簇内距离在第一次用到时才计算, 阻挡变化只让所在的簇失效
+*/
+struct hpa_cluster {
+    char valid;
+    int nnode;
+    int cap;
+    int* pos; // 入口格子
+    int* peer; // 边界另一侧与之相连的格子
+    int* dist; // nnode * nnode 的簇内距离, -1 表示簇内不可达
+};
+
+// Dijkstra 用的临时缓冲, 大小跟簇一致
+struct hpa_scratch {
+    int cap;
+    int* dist;
+    long long* heap;
+    int* ints; // 入口距离和抽象路径
+    int ints_cap;
+};
+
+struct hpa {
+    int size;
+    int cw;
+    int ch;
+    struct hpa_cluster* clusters;
+    struct hpa_scratch scratch;
+};
+
+void hpa_build(Map* m, int size);
+void hpa_free(Map* m);
+void hpa_update(Map* m, int pos);
+void hpa_invalidate_all(Map* m);
+// 把所有失效的簇算好, 之后的寻路只读抽象图, 可以多线程并发
+void hpa_refresh(Map* m);
+void hpa_scratch_free(struct hpa_scratch* sc);
+size_t hpa_scratch_memory(const struct hpa_scratch* sc);
+// 簇和抽象图占用的字节数, 不包括各个 SearchContext 里的缓冲
+size_t hpa_memory(Map* m);
+
+/*
+    分层寻路, 成功时路点按 form_ipath 的顺序写入 s->ipath 并返回 1,
+    起点终点离得太近或者抽象图上找不到路径时返回 0, 由调用方改用 jps_find_path
+*/
+int hpa_find_path(Map* m, SearchContext* s);
+
+#endif /* __HPA_H__ */
@@ -1,59 +1,28 @@
+#include <stdint.h>
+#include "connected.h"
 #include "jps.h"
 #include "fibheap.h"
+#include "openset.h"
+#include "snapshot.h"
+#include "tile.h"
 
-static struct node_data *construct(Map *m, int pos, int g_value,
+// 每次按字扫描时检查的格子数, 多读的一位用于判断强迫邻居
+#define SCAN_STEP 56
+#define SCAN_BITS (SCAN_STEP + 1)
+
+static struct node_data *construct(Map *m, SearchContext *s, int pos, int g_value,
             unsigned char dir) {
-    struct node_data *node = (struct node_data *)malloc(sizeof(struct node_data));
+    struct node_data *node = (struct node_data *)arena_alloc(&s->arena, sizeof(struct node_data));
     node->pos = pos;
     node->g_value = g_value;
-    node->f_value = g_value + dist(m->end, pos, m->width);
+    node->f_value = g_value + dist(s->end, pos, m->width);
     node->dir = dir;
     return node;
 }
 
-static int get_next_pos(int pos, unsigned char dir, int w, int h) {
-    int x = pos % w;
-    int y = pos / w;
-    switch (dir) {
-        case 0:
-            y = y - 1;
-            break;
-        case 1:
-            x = x + 1;
-            y = y - 1;
-            break;
-        case 2:
-            x = x + 1;
-            break;
-        case 3:
-            x = x + 1;
-            y = y + 1;
-            break;
-        case 4:
-            y = y + 1;
-            break;
-        case 5:
-            x = x - 1;
-            y = y + 1;
-            break;
-        case 6:
-            x = x - 1;
-            break;
-        case 7:
-            x = x - 1;
-            y = y - 1;
-            break;
-        default: return -1;
-    }
-    if (!check_in_map(x, y, w, h)) {
-        return -1;
-    }
-    return x + y * w;
-}
-
-static inline int walkable(Map *m, int pos, int cur_dir, int next_dir) {
-    return map_walkable(m, get_next_pos(pos, (cur_dir + (next_dir)) % 8, m->width, m->height));
-}
+// 每个方向的坐标增量, 顺序同 map.h 中的方向定义
+static const int dir_dx[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+static const int dir_dy[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
 
 static unsigned char natural_dir(int pos, unsigned char cur_dir, Map *m) {
     unsigned char dir_set = EMPTY_DIRECTIONSET;
@@ -70,12 +39,13 @@ static unsigned char natural_dir(int pos, unsigned char cur_dir, Map *m) {
     return dir_set;
 }
 
-static unsigned char force_dir(int pos, unsigned char cur_dir, Map *m) {
+// bit 为带边框位图中的下标, 边框都是阻挡, 不需要判断越界
+static unsigned char force_dir(Map *m, int bit, unsigned char cur_dir) {
     if (cur_dir == NO_DIRECTION) {
         return EMPTY_DIRECTIONSET;
     }
     unsigned char dir_set = EMPTY_DIRECTIONSET;
-#define WALKABLE(n) walkable(m, pos, cur_dir, n)
+#define WALKABLE(n) (!BITTEST(m->m, bit + m->bit_offset[(cur_dir + (n)) % 8]))
     if (dir_is_diagonal(cur_dir)) {
         if (WALKABLE(6) && !WALKABLE(5)) {
             dir_add(&dir_set, (cur_dir + 6) % 8);
@@ -107,56 +77,612 @@ static unsigned char next_dir(unsigned char *dirs) {
     return NO_DIRECTION;
 }
 
-static void put_in_open_set(struct heap *open_set, Map *m, int pos,
-            int len, struct node_data *node, unsigned char dir) {
-    if (!BITTEST(m->m, (BITSLOT(len) + 1) * CHAR_BIT + pos)) {
-        int ng_value = node->g_value + dist(pos, node->pos, m->width);
-        struct heap_node *p = m->open_set_map[pos];
+/*
+    取从 start 开始的一行(转置位图中为一列)上 lo 之后的阻挡位, 第 j 位对应格子 lo + j,
+    行外的格子都当作阻挡
+*/
+static inline uint64_t line_bits(const char *bits, int start, int line_len, int lo) {
+    if (lo >= line_len || lo <= -SCAN_BITS) {
+        return ~0ULL;
+    }
+    uint64_t v;
+    if (lo < 0) {
+        v = (bitmap_load(bits, start) << -lo) | ((1ULL << -lo) - 1);
+    } else {
+        v = bitmap_load(bits, start + lo);
+    }
+    if (line_len - lo < 64) {
+        v |= ~0ULL << (line_len - lo);
+    }
+    return v;
+}
+
+/*
+    沿行正方向扫描, 返回 from 之后第一个阻挡格或有强迫邻居的格子, stride 为相邻行的距离.
+    t 不为空时, 连同两侧相邻行都没有阻挡的分块一次查表整段跳过; 每进入一个新块才查一次,
+    在有阻挡的块里按字扫描时不再重复查表
+*/
+static int scan_forward(const char *bits, int start, int stride, int line_len,
+            int from, const struct tiles *t, int vertical, int line, int nline) {
+    int lo = from + 1;
+    int next_tile = t ? lo : INT_MAX; // 扫到这里时再查分块
+    for (;;) {
+        if (lo >= next_tile && lo < line_len) {
+            int k = lo >> TILE_SHIFT;
+            int run = tiles_line_run(t, vertical, line, nline, k, 1);
+            if (run) {
+                lo = (k + run) << TILE_SHIFT;
+                if (lo > line_len) {
+                    lo = line_len;
+                }
+            }
+            next_tile = ((lo >> TILE_SHIFT) + 1) << TILE_SHIFT;
+        }
+        uint64_t cur = line_bits(bits, start, line_len, lo);
+        uint64_t prev = line_bits(bits, start - stride, line_len, lo);
+        uint64_t next = line_bits(bits, start + stride, line_len, lo);
+        uint64_t stop = cur | (prev & ~(prev >> 1)) | (next & ~(next >> 1));
+        stop &= (1ULL << SCAN_STEP) - 1;
+        if (stop) {
+            return lo + __builtin_ctzll(stop);
+        }
+        lo += SCAN_STEP;
+    }
+}
+
+// 沿行反方向扫描, 返回 from 之前第一个阻挡格或有强迫邻居的格子
+static int scan_backward(const char *bits, int start, int stride, int line_len,
+            int from, const struct tiles *t, int vertical, int line, int nline) {
+    int lo = from - 1 - SCAN_STEP;
+    int next_tile = t ? lo + SCAN_STEP : -1; // 扫到这里(含)以前时再查分块
+    for (;;) {
+        // 本次要检查的是 lo + 1 ~ lo + SCAN_STEP
+        int hi = lo + SCAN_STEP;
+        if (hi <= next_tile && hi >= 0) {
+            int k = hi >> TILE_SHIFT;
+            int run = tiles_line_run(t, vertical, line, nline, k, 0);
+            if (run) {
+                hi = ((k - run + 1) << TILE_SHIFT) - 1;
+                lo = hi - SCAN_STEP;
+            }
+            next_tile = ((hi >> TILE_SHIFT) << TILE_SHIFT) - 1;
+        }
+        uint64_t cur = line_bits(bits, start, line_len, lo);
+        uint64_t prev = line_bits(bits, start - stride, line_len, lo);
+        uint64_t next = line_bits(bits, start + stride, line_len, lo);
+        uint64_t stop = cur | (prev & ~(prev << 1)) | (next & ~(next << 1));
+        stop &= ((1ULL << SCAN_STEP) - 1) << 1;
+        if (stop) {
+            return lo + 63 - __builtin_clzll(stop);
+        }
+        lo -= SCAN_STEP;
+    }
+}
+
+// 一次跳点搜索共用的状态
+struct jump_ctx {
+    Map *m;
+    SearchContext *s;
+    struct heap *open_set;
+    struct node_data *node;
+    int end;
+    int ex, ey;
+    int end_bit;
+};
+
+/*
+    双向寻路时 from 经直线或斜线到达另一侧访问过的 pos 就是一次相遇,
+    路径为起点到 from, from 到 pos, pos 到终点, 长度为两侧 g 值之和
+*/
+static inline void record_meet(SearchContext *s, int from, int pos, int g_value) {
+    SearchContext *o = s->other;
+    if (o->gen[pos] == o->search_gen || o->gen[pos] == o->search_gen + 1) {
+        int total = g_value + o->cell_g[pos];
+        if (total < s->meet_g) {
+            s->meet = pos;
+            s->meet_from = from;
+            s->meet_g = total;
+        }
+    }
+}
+
+// 双向寻路时在 mark 和 tmark 中记下本侧访问过的格子
+static void set_mark(Map *m, SearchContext *s, int pos) {
+    int x, y;
+    pos2xy(m, pos, &x, &y);
+    if (s->nmarked == s->marked_cap) {
+        s->marked_cap = s->marked_cap ? s->marked_cap * 2 : 64;
+        s->marked = (int *)realloc(s->marked, s->marked_cap * sizeof(int));
+    }
+    s->marked[s->nmarked++] = pos;
+    BITSET(s->mark, xy2bit(m, x, y));
+    BITSET(s->tmark, (x + 1) * (m->height + 2) + y + 1);
+}
+
+// 清除上次双向寻路留下的 mark, 位图第一次用到时才分配
+static void reset_marks(Map *m, SearchContext *s) {
+    int i;
+    if (!s->mark) {
+        s->mark_len = BITMAP_LEN(m->width, m->height);
+        s->mark = (char *)calloc(s->mark_len, 1);
+        s->tmark = (char *)calloc(s->mark_len, 1);
+    }
+    for (i = 0; i < s->nmarked; i++) {
+        int x, y;
+        pos2xy(m, s->marked[i], &x, &y);
+        BITCLEAR(s->mark, xy2bit(m, x, y));
+        BITCLEAR(s->tmark, (x + 1) * (m->height + 2) + y + 1);
+    }
+    s->nmarked = 0;
+}
+
+// 把 pos 作为当前节点 c->node 的后继放入 open_set
+static void put_in_open_set(struct jump_ctx *c, int pos, unsigned char dir) {
+    SearchContext *s = c->s;
+    struct node_data *node = c->node;
+    unsigned int gen = s->gen[pos];
+    if (gen != s->search_gen + 1) {
+        if (gen != s->search_gen) {
+            touch(s, pos);
+            if (s->other) {
+                set_mark(c->m, s, pos);
+            }
+        }
+        int ng_value = node->g_value + dist(pos, node->pos, c->m->width);
+        struct node_data *p = open_set_find(s, pos);
         if (!p) {
-            m->comefrom[pos] = node->pos;
-            struct node_data *test = construct(m, pos, ng_value, dir);
-            m->open_set_map[pos] = fibheap_insert(open_set, test);
-        } else if (p->data->g_value > ng_value) {
-            m->comefrom[pos] = node->pos;
-            p->data->f_value = p->data->f_value - (p->data->g_value - ng_value);
-            p->data->g_value = ng_value;
-            p->data->dir = dir;
-            fibheap_decrease(open_set, p);
+            s->comefrom[pos] = node->pos;
+            open_set_push(c->open_set, s, construct(c->m, s, pos, ng_value, dir));
+        } else if (p->g_value > ng_value) {
+            s->comefrom[pos] = node->pos;
+            p->f_value = p->f_value - (p->g_value - ng_value);
+            p->g_value = ng_value;
+            p->dir = dir;
+            open_set_decrease(c->open_set, s, p);
+        } else {
+            return;
+        }
+        if (s->other) {
+            s->cell_g[pos] = ng_value;
+            record_meet(s, node->pos, pos, ng_value);
         }
     }
 }
 
+/*
+    双向寻路时找出 from 与 stop 之间(不含两端)另一侧访问过的第一个格子, 没有时返回 -1.
+    start 开始的一行在 mark 中的位置与阻挡位图相同, stop 最远是边框, 不会越界
+*/
+static int scan_mark(const char *mark, int start, int from, int stop) {
+    if (stop > from) {
+        int lo;
+        for (lo = from + 1; lo < stop; lo += SCAN_STEP) {
+            uint64_t v = bitmap_load(mark, start + lo) & ((1ULL << SCAN_STEP) - 1);
+            if (v) {
+                int k = lo + __builtin_ctzll(v);
+                return k < stop ? k : -1;
+            }
+        }
+    } else {
+        int hi;
+        for (hi = from - 1; hi > stop; hi -= SCAN_STEP) {
+            int lo = hi - SCAN_STEP + 1 > stop + 1 ? hi - SCAN_STEP + 1 : stop + 1;
+            uint64_t v = bitmap_load(mark, start + lo) & ((1ULL << (hi - lo + 1)) - 1);
+            if (v) {
+                return lo + 63 - __builtin_clzll(v);
+            }
+        }
+    }
+    return -1;
+}
 
-static int jump_prune(struct heap *open_set, int end, int pos, unsigned char dir,
-            Map *m, struct node_data *node) {
+/*
+    直线扫过的格子中另一侧访问过的都是相遇点, 只记录不放入 open_set,
+    放入的话会打乱本侧跳点搜索的展开顺序
+*/
+static void scan_meets(struct jump_ctx *c, int x, int y, int stop, unsigned char dir) {
+    Map *m = c->m;
+    const SearchContext *o = c->s->other;
+    struct node_data *node = c->node;
+    int w = m->width;
+    int vertical = dir == 0 || dir == 4;
+    const char *mark = vertical ? o->tmark : o->mark;
+    int start = vertical ? (x + 1) * (m->height + 2) + 1 : (y + 1) * (w + 2) + 1;
+    int k = vertical ? y : x;
+    while ((k = scan_mark(mark, start, k, stop)) >= 0) {
+        int pos = vertical ? x + k * w : k + y * w;
+        record_meet(c->s, node->pos, pos, node->g_value + dist(pos, node->pos, w));
+    }
+}
+
+/*
+    直线方向的跳点搜索, 横向用原位图, 纵向用转置位图, 每次检查一个字.
+    扫描停下的格子最远是边框, 直接测位即可
+*/
+static int jump_straight(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    Map *m = c->m;
     int w = m->width;
     int h = m->height;
-    int len = w * h;
-    int next_pos = get_next_pos(pos, dir, w, h);
-    // printf("next_pos:%d\n", next_pos);
-    if (!map_walkable(m, next_pos)) {
-        return 0;
+    int row = (y + 1) * (w + 2) + 1;
+    int col = (x + 1) * (h + 2) + 1;
+    int stop, on_line, blocked;
+    switch (dir) {
+        case 0:
+            stop = scan_backward(m->tm, col, h + 2, h, y, m->tiles, 1, x, w);
+            on_line = c->ex == x && c->ey < y && c->ey > stop;
+            blocked = BITTEST(m->tm, col + stop);
+            break;
+        case 2:
+            stop = scan_forward(m->m, row, w + 2, w, x, m->tiles, 0, y, h);
+            on_line = c->ey == y && c->ex > x && c->ex < stop;
+            blocked = BITTEST(m->m, row + stop);
+            break;
+        case 4:
+            stop = scan_forward(m->tm, col, h + 2, h, y, m->tiles, 1, x, w);
+            on_line = c->ex == x && c->ey > y && c->ey < stop;
+            blocked = BITTEST(m->tm, col + stop);
+            break;
+        case 6:
+            stop = scan_backward(m->m, row, w + 2, w, x, m->tiles, 0, y, h);
+            on_line = c->ey == y && c->ex < x && c->ex > stop;
+            blocked = BITTEST(m->m, row + stop);
+            break;
+        default: return 0;
     }
-    if (next_pos == end) {
-        put_in_open_set(open_set, m, next_pos, len, node, dir);
+    if (on_line) {
+        put_in_open_set(c, c->end, dir);
         return 1;
     }
-    if (force_dir(next_pos, dir, m) != EMPTY_DIRECTIONSET) {
-        put_in_open_set(open_set, m, next_pos, len, node, dir);
+    if (c->s->other) {
+        scan_meets(c, x, y, stop, dir);
+    }
+    if (blocked) {
         return 0;
     }
-    if (dir_is_diagonal(dir)) {
-        int i;
-        i = jump_prune(open_set, end, next_pos, (dir + 7) % 8, m, node);
-        if (i == 1) {
+    int stop_pos = (dir == 0 || dir == 4) ? x + stop * w : stop + y * w;
+    put_in_open_set(c, stop_pos, dir);
+    return stop_pos == c->end;
+}
+
+// 斜向跳点搜索, 逐格前进, 每一格再向两侧做直线搜索
+static int jump_diagonal(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    Map *m = c->m;
+    int w = m->width;
+    int step = m->bit_offset[dir];
+    int bit = xy2bit(m, x, y);
+    for (;;) {
+        bit += step;
+        x += dir_dx[dir];
+        y += dir_dy[dir];
+        if (BITTEST(m->m, bit)) {
+            return 0;
+        }
+        if (bit == c->end_bit) {
+            put_in_open_set(c, c->end, dir);
+            return 1;
+        }
+        if (force_dir(m, bit, dir) != EMPTY_DIRECTIONSET) {
+            put_in_open_set(c, x + y * w, dir);
+            return 0;
+        }
+        if (c->s->other && BITTEST(c->s->other->mark, bit)) {
+            int pos = x + y * w;
+            record_meet(c->s, c->node->pos, pos, c->node->g_value + dist(pos, c->node->pos, w));
+        }
+        if (jump_straight(c, x, y, (dir + 7) % 8) == 1) {
             return 1;
         }
-        i = jump_prune(open_set, end, next_pos, (dir + 1) % 8, m, node);
-        if (i == 1) {
+        if (jump_straight(c, x, y, (dir + 1) % 8) == 1) {
             return 1;
         }
     }
-    return jump_prune(open_set, end, next_pos, dir, m, node);
+}
+
+/*
+    JPS+ 查表版本的跳点搜索, 与上面的扫描版本放入 open_set 的格子和顺序完全一致.
+    end 不在表里, 每次查表后再判断终点是否落在可达范围内
+*/
+
+static inline int jump_entry(Map *m, int pos, unsigned char dir) {
+    return m->jump_table[pos * 8 + dir];
+}
+
+// 从 (x, y) 沿 dir 走多少步到达终点, 不在这条射线上时返回 -1
+static inline int steps_to_end(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    int dx = dir_dx[dir], dy = dir_dy[dir];
+    int kx = dx ? (c->ex - x) * dx : 0;
+    int ky = dy ? (c->ey - y) * dy : 0;
+    if ((dx && kx <= 0) || (dy && ky <= 0) || (!dx && c->ex != x) || (!dy && c->ey != y)) {
+        return -1;
+    }
+    if (dx && dy && kx != ky) {
+        return -1;
+    }
+    return dx ? kx : ky;
+}
+
+static int jump_straight_plus(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    Map *m = c->m;
+    int step = dir_dx[dir] + dir_dy[dir] * m->width;
+    int pos = x + y * m->width;
+    int k = 0, v;
+    while ((v = jump_entry(m, pos, dir)) == JUMP_HOP || v == WALL_HOP) {
+        k += JUMP_SPAN_MAX;
+        pos += JUMP_SPAN_MAX * step;
+    }
+    int reach = k + (v > 0 ? v : -v);
+    int e = steps_to_end(c, x, y, dir);
+    if (e > 0 && e <= reach) {
+        put_in_open_set(c, c->end, dir);
+        return 1;
+    }
+    if (v > 0) {
+        put_in_open_set(c, pos + v * step, dir);
+    }
+    return 0;
+}
+
+#define CELL_NEXT 0
+#define CELL_FOUND 1
+#define CELL_STOP 2
+
+// 斜向路径上单个格子的处理, 对应 jump_diagonal 循环体
+static int diagonal_cell_plus(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    Map *m = c->m;
+    int pos = x + y * m->width;
+    if (pos == c->end) {
+        put_in_open_set(c, c->end, dir);
+        return CELL_FOUND;
+    }
+    if (force_dir(m, xy2bit(m, x, y), dir) != EMPTY_DIRECTIONSET) {
+        put_in_open_set(c, pos, dir);
+        return CELL_STOP;
+    }
+    if (jump_straight_plus(c, x, y, (dir + 7) % 8) == 1) {
+        return CELL_FOUND;
+    }
+    if (jump_straight_plus(c, x, y, (dir + 1) % 8) == 1) {
+        return CELL_FOUND;
+    }
+    return CELL_NEXT;
+}
+
+/*
+    斜向查表跳过中间没有跳点的格子, 但终点所在行列上的格子仍要检查一遍,
+    因为从那里出发的直线搜索可能碰到终点
+*/
+static int jump_diagonal_plus(struct jump_ctx *c, int x, int y, unsigned char dir) {
+    Map *m = c->m;
+    int dx = dir_dx[dir], dy = dir_dy[dir];
+    int pos = x + y * m->width;
+    int step = dx + dy * m->width;
+    int e1 = (c->ex - x) * dx;
+    int e2 = (c->ey - y) * dy;
+    if (e1 > e2) {
+        int t = e1; e1 = e2; e2 = t;
+    }
+    int k = 0;
+    for (;;) {
+        int v = jump_entry(m, pos, dir);
+        int hop = v == JUMP_HOP || v == WALL_HOP;
+        int span = hop ? JUMP_SPAN_MAX : (v > 0 ? v : -v);
+        // (k, last] 之间都是可走且不是跳点的格子
+        int last = k + ((!hop && v > 0) ? span - 1 : span);
+        if (e1 > k && e1 <= last
+                && diagonal_cell_plus(c, x + e1 * dx, y + e1 * dy, dir) == CELL_FOUND) {
+            return 1;
+        }
+        if (e2 != e1 && e2 > k && e2 <= last
+                && diagonal_cell_plus(c, x + e2 * dx, y + e2 * dy, dir) == CELL_FOUND) {
+            return 1;
+        }
+        if (hop) {
+            k += JUMP_SPAN_MAX;
+            pos += JUMP_SPAN_MAX * step;
+            continue;
+        }
+        if (v <= 0) {
+            return 0;
+        }
+        k += v;
+        pos += v * step;
+        int r = diagonal_cell_plus(c, x + k * dx, y + k * dy, dir);
+        if (r != CELL_NEXT) {
+            return r == CELL_FOUND;
+        }
+    }
+}
+
+/*
+    建表时每格的中间值: 正数 n 表示第 n 格是跳点, 非正数 -n 表示连续 n 格可走后碰到阻挡
+*/
+static inline signed char encode_jump(int raw) {
+    if (raw > JUMP_SPAN_MAX) {
+        return JUMP_HOP;
+    }
+    if (raw < -JUMP_SPAN_MAX) {
+        return WALL_HOP;
+    }
+    return raw;
+}
+
+// 格子在 dir 方向上是否是跳点, 斜向时还要看两侧的直线方向有没有跳点
+static inline int is_jump_cell(Map *m, int pos, int bit, unsigned char dir) {
+    if (force_dir(m, bit, dir) != EMPTY_DIRECTIONSET) {
+        return 1;
+    }
+    return dir_is_diagonal(dir)
+        && (jump_entry(m, pos, (dir + 7) % 8) > 0 || jump_entry(m, pos, (dir + 1) % 8) > 0);
+}
+
+// 写入格子的表项, raw 为前方格子给出的中间值, 返回该格子给身后格子的中间值
+static inline int fill_entry(Map *m, int pos, int bit, unsigned char dir, int raw) {
+    if (BITTEST(m->m, bit)) {
+        m->jump_table[pos * 8 + dir] = 0;
+        return 0;
+    }
+    m->jump_table[pos * 8 + dir] = encode_jump(raw);
+    if (is_jump_cell(m, pos, bit, dir)) {
+        return 1;
+    }
+    return raw > 0 ? raw + 1 : raw - 1;
+}
+
+/*
+    从一条线在 dir 方向上的最后一格往回重算整条线的表项,
+    changed 不为 NULL 时记录跳点/阻挡类型发生变化的格子
+*/
+static void build_line(Map *m, int x, int y, unsigned char dir, int *changed, int *nchanged) {
+    int w = m->width, h = m->height;
+    int dx = dir_dx[dir], dy = dir_dy[dir];
+    while (check_in_map(x + dx, y + dy, w, h)) {
+        x += dx;
+        y += dy;
+    }
+    int raw = 0;
+    while (check_in_map(x, y, w, h)) {
+        int pos = x + y * w;
+        signed char old = jump_entry(m, pos, dir);
+        raw = fill_entry(m, pos, xy2bit(m, x, y), dir, raw);
+        if (changed && (old > 0) != (jump_entry(m, pos, dir) > 0)) {
+            changed[(*nchanged)++] = pos;
+        }
+        x -= dx;
+        y -= dy;
+    }
+}
+
+/*
+    整张表按行扫描, 对每一列(斜向为每条斜线)各保留前方格子的中间值,
+    比逐条线回溯对缓存友好
+*/
+static void build_dir(Map *m, unsigned char dir, int *prev, int *cur) {
+    int w = m->width, h = m->height;
+    int dx = dir_dx[dir], dy = dir_dy[dir];
+    int x, y, i, j, *t;
+    // 下标偏移一格, 两端的哨兵表示地图外
+    memset(prev, 0, (w + 2) * sizeof(int));
+    for (i = 0; i < h; i++) {
+        y = dy > 0 ? h - 1 - i : i;
+        cur[0] = cur[w + 1] = 0;
+        for (j = 0; j < w; j++) {
+            x = dx > 0 ? w - 1 - j : j;
+            int raw = dy ? prev[x + dx + 1] : cur[x + dx + 1];
+            cur[x + 1] = fill_entry(m, x + y * w, xy2bit(m, x, y), dir, raw);
+        }
+        t = prev;
+        prev = cur;
+        cur = t;
+    }
+}
+
+void jps_plus_build(Map *m) {
+    int w = m->width, h = m->height;
+    map_unshare(m);
+    if (!m->jump_table) {
+        // 之前共享时关掉过的话网格里还留着旧表, 直接重算覆盖
+        m->jump_table = m->grid->jump_table;
+    }
+    if (!m->jump_table) {
+        m->jump_table = (signed char *)malloc(w * h * 8 * sizeof(signed char));
+        m->grid->jump_table = m->jump_table;
+    }
+    int *rows = (int *)malloc((w + 2) * 2 * sizeof(int));
+    int i;
+    // 斜向的表依赖直线方向的表, 先算直线方向
+    for (i = 0; i < 8; i += 2) {
+        build_dir(m, i, rows, rows + w + 2);
+    }
+    for (i = 1; i < 8; i += 2) {
+        build_dir(m, i, rows, rows + w + 2);
+    }
+    free(rows);
+}
+
+void jps_plus_update(Map *m, int pos) {
+    int w = m->width, h = m->height;
+    int x0 = pos % w, y0 = pos / w;
+    int i, j, n = 0;
+    unsigned char dir;
+    // 直线方向: 所在行列以及相邻行列上的强迫邻居都可能变化
+    int *changed = (int *)malloc(6 * (w + h) * 2 * sizeof(int));
+    int *dirs = changed + 6 * (w + h);
+    for (i = -1; i <= 1; i++) {
+        for (dir = 0; dir < 8; dir += 2) {
+            int vertical = dir == 0 || dir == 4;
+            int x = vertical ? x0 + i : 0;
+            int y = vertical ? 0 : y0 + i;
+            if (!check_in_map(x, y, w, h)) {
+                continue;
+            }
+            int before = n;
+            build_line(m, x, y, dir, changed, &n);
+            for (j = before; j < n; j++) {
+                dirs[j] = dir;
+            }
+        }
+    }
+    /*
+        斜向: 变化格周围 3x3 以及直线表项类型变化的格子所在的斜线,
+        同一条斜线只重算一次
+    */
+    char *done = (char *)calloc(4 * (w + h), sizeof(char));
+#define DIAG_LINE(x, y, d) (((d) == 1 || (d) == 5) ? (x) + (y) : (x) - (y) + h - 1)
+#define REBUILD_DIAG(x, y, d) do { \
+    char *flag = &done[((d) / 2) * (w + h) + DIAG_LINE(x, y, d)]; \
+    if (!*flag) { \
+        *flag = 1; \
+        build_line(m, x, y, d, NULL, NULL); \
+    } \
+} while (0)
+    for (i = -1; i <= 1; i++) {
+        for (j = -1; j <= 1; j++) {
+            if (check_in_map(x0 + i, y0 + j, w, h)) {
+                for (dir = 1; dir < 8; dir += 2) {
+                    REBUILD_DIAG(x0 + i, y0 + j, dir);
+                }
+            }
+        }
+    }
+    for (j = 0; j < n; j++) {
+        int x = changed[j] % w, y = changed[j] / w;
+        REBUILD_DIAG(x, y, (dirs[j] + 1) % 8);
+        REBUILD_DIAG(x, y, (dirs[j] + 7) % 8);
+    }
+#undef REBUILD_DIAG
+#undef DIAG_LINE
+    free(done);
+    free(changed);
+}
+
+int jps_plus_check(const signed char *table, int w, int h) {
+    int x, y;
+    unsigned char dir;
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            const signed char *e = table + (x + y * w) * 8;
+            for (dir = 0; dir < 8; dir++) {
+                int v = e[dir];
+                int n = (v == JUMP_HOP || v == WALL_HOP) ? JUMP_SPAN_MAX : (v > 0 ? v : -v);
+                if (!check_in_map(x + n * dir_dx[dir], y + n * dir_dy[dir], w, h)) {
+                    return 0;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+void jps_plus_free(Map *m) {
+    struct grid* g = m->grid;
+    // 网格被共享时跳点表还有别人在用, 只是自己不再使用
+    if (m->jump_table && g && __atomic_load_n(&g->ref, __ATOMIC_ACQUIRE) == 1) {
+        if (!snapshot_contains(g->snapshot, m->jump_table)) {
+            free(m->jump_table);
+        }
+        g->jump_table = NULL;
+    }
+    m->jump_table = NULL;
 }
 
 static inline int compare(struct node_data* old, struct node_data* new) {
@@ -167,38 +693,176 @@ static inline int compare(struct node_data* old, struct node_data* new) {
     }
 }
 
-int jps_find_path(Map *m) {
+int jps_start(Map *m, SearchContext *s) {
     int len = m->width * m->height;
-    memset(&m->m[BITSLOT(len) + 1], 0, (BITSLOT(len) + 1) * sizeof(m->m[0]));
-    memset(m->comefrom, -1, len * sizeof(int));
-    memset(m->open_set_map, 0, len * sizeof(struct heap_node *));
-    if (m->start == m->end) {
-        return m->end;
+    search_ctx_prepare(s);
+    s->other = NULL;
+    s->search_gen += 2;
+    if (s->search_gen >= UINT_MAX - 1) {
+        memset(s->gen, 0, len * sizeof(unsigned int));
+        s->search_gen = 2;
     }
-    if (m->mark_connected && (m->connected[m->start] != m->connected[m->end])) {
-        return -1;
+    s->expanded = 0;
+    s->closest = s->start;
+    s->closest_h = dist(s->end, s->start, m->width);
+    touch(s, s->start);
+    if (s->start == s->end) {
+        return s->end;
+    }
+    if (m->mark_connected && (map_connected_id(m, s->start) != map_connected_id(m, s->end))) {
+        return SEARCH_NONE;
+    }
+    arena_reset(&s->arena);
+    s->open_set = NULL;
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        dheap_reset(&s->open_heap, (int *)s->open_set_map, compare);
+    } else {
+        s->open_set = fibheap_init(&s->arena, len, compare);
     }
-    struct heap *open_set = fibheap_init(len, compare);
-    struct node_data *node = construct(m, m->start, 0, NO_DIRECTION);
-    m->open_set_map[m->start] = fibheap_insert(open_set, node);;
-    while ((node = fibheap_pop(open_set))) {
-        m->open_set_map[node->pos] = NULL;
-        BITSET(m->m, (BITSLOT(len) + 1) * CHAR_BIT + node->pos);
+    struct node_data *node = construct(m, s, s->start, 0, NO_DIRECTION);
+    open_set_push(s->open_set, s, node);
+    return SEARCH_PENDING;
+}
 
-        if (node->pos == m->end) {
-            fibheap_destroy(open_set);
+int jps_step(Map *m, SearchContext *s, int n) {
+    struct jump_ctx c;
+    c.m = m;
+    c.s = s;
+    c.open_set = s->open_set;
+    c.end = s->end;
+    pos2xy(m, s->end, &c.ex, &c.ey);
+    c.end_bit = xy2bit(m, c.ex, c.ey);
+    struct node_data *node;
+    for (; n > 0; n--) {
+        if (!(node = open_set_pop(c.open_set, s))) {
+            return SEARCH_NONE;
+        }
+        s->gen[node->pos] = s->search_gen + 1;
+        s->expanded++;
+
+        if (node->pos == s->end) {
             return node->pos;
         }
+        // f - g 就是到终点的估价
+        if (node->f_value - node->g_value < s->closest_h) {
+            s->closest = node->pos;
+            s->closest_h = node->f_value - node->g_value;
+        }
+        int x, y;
+        pos2xy(m, node->pos, &x, &y);
+        c.node = node;
         unsigned char cur_dir = node->dir;
-        unsigned char check_dirs = natural_dir(node->pos, cur_dir, m) | force_dir(node->pos, cur_dir, m);
+        unsigned char check_dirs = natural_dir(node->pos, cur_dir, m) | force_dir(m, xy2bit(m, x, y), cur_dir);
         unsigned char dir = next_dir(&check_dirs);
         while (dir != NO_DIRECTION) {
-            if (jump_prune(open_set, m->end, node->pos, dir, m, node) == 1) { // found end
+            int found;
+            // 双向寻路要在扫描途中发现另一侧的格子, 不用查表
+            if (m->jump_table && !s->other) {
+                found = dir_is_diagonal(dir) ? jump_diagonal_plus(&c, x, y, dir) : jump_straight_plus(&c, x, y, dir);
+            } else {
+                found = dir_is_diagonal(dir) ? jump_diagonal(&c, x, y, dir) : jump_straight(&c, x, y, dir);
+            }
+            if (found == 1) { // found end
                 break;
             }
             dir = next_dir(&check_dirs);
         }
     }
-    fibheap_destroy(open_set);
-    return -1;
+    return SEARCH_PENDING;
+}
+
+int jps_find_path(Map *m, SearchContext *s) {
+    int ret = jps_start(m, s);
+    if (ret == SEARCH_PENDING) {
+        ret = jps_step(m, s, s->max_expanded > 0 ? s->max_expanded : INT_MAX);
+    }
+    return ret;
+}
+
+// 结束双向寻路, ret >= 0 时两侧的 meet 中路径较短的一个就是结果
+static int bidir_finish(SearchContext *s, int ret) {
+    s->other->other = NULL;
+    s->other = NULL;
+    return ret;
+}
+
+int jps_bidir_start(Map *m, SearchContext *s) {
+    if (!s->reverse) {
+        s->reverse = (SearchContext *)malloc(sizeof(SearchContext));
+        search_ctx_init(s->reverse, s->len);
+    }
+    SearchContext *r = s->reverse;
+    r->open_list = s->open_list;
+    r->start = s->end;
+    r->end = s->start;
+    int ret = jps_start(m, s);
+    if (ret != SEARCH_PENDING) {
+        return ret;
+    }
+    jps_start(m, r);
+    search_ctx_prepare_cell_g(s);
+    search_ctx_prepare_cell_g(r);
+    reset_marks(m, s);
+    reset_marks(m, r);
+    set_mark(m, s, s->start);
+    set_mark(m, r, r->start);
+    s->cell_g[s->start] = 0;
+    r->cell_g[r->start] = 0;
+    s->meet = r->meet = -1;
+    s->meet_from = r->meet_from = -1;
+    s->meet_g = r->meet_g = INT_MAX;
+    s->other = r;
+    r->other = s;
+    return SEARCH_PENDING;
+}
+
+int jps_bidir_step(Map *m, SearchContext *s, int n) {
+    SearchContext *r = s->other;
+    if (!r) {
+        return SEARCH_NONE;
+    }
+    for (; n > 0; n--) {
+        struct node_data *fs = open_set_peek(s->open_set, s);
+        struct node_data *fr = open_set_peek(r->open_set, r);
+        int best = s->meet_g < r->meet_g ? s->meet_g : r->meet_g;
+        // 一侧搜完时已有的相遇点就是最短的
+        if (!fs || !fr) {
+            return bidir_finish(s, best < INT_MAX ? s->end : SEARCH_NONE);
+        }
+        /*
+            两侧都是不受对方干扰的跳点搜索, 各自 open_set 中总有最短路径上的节点,
+            最小 f 值都不超过最短路径长度, 相遇路径不比较大者长时就是最短的
+        */
+        int bound = fs->f_value > fr->f_value ? fs->f_value : fr->f_value;
+        if (best <= bound) {
+            return bidir_finish(s, s->end);
+        }
+        // 每次扩展 open_set 较小的一侧
+        SearchContext *side = s->open_list == OPEN_LIST_DHEAP
+            ? (s->open_heap.size <= r->open_heap.size ? s : r)
+            : (s->open_set->node_num <= r->open_set->node_num ? s : r);
+        int before = r->expanded;
+        int ret = jps_step(m, side, 1);
+        // s->expanded 统计两侧的总数
+        s->expanded += r->expanded - before;
+        if (ret >= 0) {
+            // 一侧直接到达了目标, 相遇点就是目标本身
+            side->meet = side->meet_from = ret;
+            side->meet_g = side->cell_g[ret];
+            side->other->meet_g = INT_MAX;
+            return bidir_finish(s, s->end);
+        }
+    }
+    return SEARCH_PENDING;
+}
+
+int jps_bidir_find_path(Map *m, SearchContext *s) {
+    int ret = jps_bidir_start(m, s);
+    if (ret == SEARCH_PENDING) {
+        ret = jps_bidir_step(m, s, s->max_expanded > 0 ? s->max_expanded : INT_MAX);
+    }
+    if (ret == SEARCH_PENDING) {
+        bidir_finish(s, ret);
+    }
+    return ret;
 }
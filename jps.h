@@ -3,6 +3,41 @@
 
 #include "map.h"
 
-int jps_find_path(Map* m);
+/*
+    返回终点; 找不到路径返回 SEARCH_NONE;
+    展开节点数达到 s->max_expanded 时返回 SEARCH_PENDING, 此时 s->closest 是已展开节点中离终点最近的
+*/
+int jps_find_path(Map* m, SearchContext* s);
+// 分步寻路: jps_start 之后反复调用 jps_step, 每次最多展开 n 个节点, 返回值同上
+int jps_start(Map* m, SearchContext* s);
+int jps_step(Map* m, SearchContext* s, int n);
+
+/*
+    双向跳点寻路: 从终点出发的反向搜索用 s->reverse, 两侧各自做完整的跳点搜索,
+    扫描途经另一侧访问过的格子或放入 open_set 的格子已被另一侧访问过时, 只在 meet 中记下相遇路径.
+    每次扩展 open_set 较小的一侧, 最短的相遇路径不长于两侧最小 f 值的较大者时停止. 不查 JPS+ 表.
+    找到路径时返回终点, 路点由 path.c 按两侧的 meet 拼接 comefrom 得到; 其余返回值同 jps_find_path,
+    n 和 s->expanded 都是两侧合计的展开数
+*/
+int jps_bidir_find_path(Map* m, SearchContext* s);
+int jps_bidir_start(Map* m, SearchContext* s);
+int jps_bidir_step(Map* m, SearchContext* s, int n);
+
+/*
+    JPS+ 跳点距离表, 每格每个方向一个字节:
+    1 ~ JUMP_SPAN_MAX 表示该方向第 n 格是跳点,
+    -JUMP_SPAN_MAX ~ 0 表示连续 -n 格可走之后碰到阻挡,
+    JUMP_HOP / WALL_HOP 表示前 JUMP_SPAN_MAX 格都不是跳点, 需要从那一格继续查表,
+    两者分别对应最终碰到跳点和碰到阻挡
+*/
+#define JUMP_SPAN_MAX 126
+#define JUMP_HOP 127
+#define WALL_HOP (-128)
+
+void jps_plus_build(Map* m);
+void jps_plus_update(Map* m, int pos);
+void jps_plus_free(Map* m);
+// 检查不可信的表(如快照里读出的): 每个表项跳过的格子都在地图内时返回 1
+int jps_plus_check(const signed char* table, int w, int h);
 
 #endif /* __JPS__ */
\ No newline at end of file
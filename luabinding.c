@@ -6,12 +6,20 @@
 #include "lua.h"
 #include "lualib.h"
 
+#include "connected.h"
 #include "fibheap.h"
+#include "graph.h"
+#include "hpa.h"
 #include "jps.h"
 #include "map.h"
+#include "path.h"
+#include "pool.h"
 #include "smooth.h"
+#include "snapshot.h"
+#include "tile.h"
 
 #define MT_NAME ("_nav_metatable")
+#define SEARCH_MT_NAME ("_nav_search_metatable")
 
 static inline int getfield(lua_State* L, const char* f) {
     if (lua_getfield(L, -1, f) != LUA_TNUMBER) {
@@ -26,7 +34,7 @@ static inline int setobstacle(lua_State* L, Map* m, int x, int y) {
     if (!check_in_map(x, y, m->width, m->height)) {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
     }
-    BITSET(m->m, m->width * y + x);
+    map_set_block(m, m->width * y + x);
     return 0;
 }
 
@@ -34,9 +42,10 @@ static void push_path_to_istack(lua_State* L, Map* m) {
     lua_newtable(L);
     int i, x, y;
     int num = 1;
-    for (i = m->ipath_len - 1; i >= 0; i--) {
-        pos2xy(m, m->ipath[i], &x, &y);
-        // printf("pos:%d x:%d y:%d\n", m->ipath[i], x, y);
+    SearchContext* s = &m->ctx;
+    for (i = s->ipath_len - 1; i >= 0; i--) {
+        pos2xy(m, s->ipath[i], &x, &y);
+        // printf("pos:%d x:%d y:%d\n", s->ipath[i], x, y);
         lua_newtable(L);
         lua_pushinteger(L, x);
         lua_rawseti(L, -2, 1);
@@ -55,150 +64,12 @@ static void push_fpos(lua_State* L, float fx, float fy, int num) {
     lua_rawseti(L, -2, num);
 }
 
-static void find_walkable_point_in_cell(Map* m, int center_pos, float fx1, float fy1,
-    float fx2, float fy2, float* x, float* y) {
-    int x0, y0, ix, iy;
-    float fx0, fy0;
-    pos2xy(m, center_pos, &ix, &iy);
-
-    for(x0 = ix; x0 <= ix + 1; x0 ++) {
-        for(y0 = iy; y0 <= iy + 1; y0 ++) {
-            fx0 = x0 == ix ? x0 - 0.1 : x0 + 0.1;
-            fy0 = y0 == iy ? y0 - 0.1 : y0 + 0.1;
-            if(find_line_obstacle(m, fx0, fy0, fx1, fy1) < 0 && find_line_obstacle(m, fx0, fy0, fx2, fy2) < 0) {
-                *x = x0;
-                *y = y0;
-                return;
-            }
-        }
-    }
-}
-
-static void push_path_to_fstack(lua_State* L,
-                                Map* m,
-                                float fx1,
-                                float fy1,
-                                float fx2,
-                                float fy2) {
-    lua_newtable(L);
-    int i, ix, iy;
-    float fx, fy;
-    int num = 1;
-    if (m->ipath_len < 2) {
-        return;
-    }
-
-    push_fpos(L, fx1, fy1, num++);
-    pos2xy(m, m->ipath[m->ipath_len - 2], &ix, &iy);
-
-    int obs_pos = find_line_obstacle(m, fx1, fy1, ix + 0.5, iy + 0.5);
-    if (obs_pos >= 0) {
-        // 插入起点到第二个路点间的拐点
-        fx = -1;
-        fy = -1;
-        find_walkable_point_in_cell(m, obs_pos, ix + 0.5, iy + 0.5, fx1, fy1, &fx, &fy);
-        if(fx >= 0 && fy >= 0) {
-            push_fpos(L, fx, fy, num++);
-        }
-    }
-
-    for (i = m->ipath_len - 2; i >= 1; i--) {
-        pos2xy(m, m->ipath[i], &ix, &iy);
-        push_fpos(L, ix + 0.5, iy + 0.5, num++);
-    }
-
-    if (m->ipath_len > 2) {
-        // 插入倒数第二个路点到终点间的拐点
-        obs_pos = find_line_obstacle(m, ix + 0.5, iy + 0.5, fx2, fy2);
-        if (obs_pos >= 0) {
-            fx = -1;
-            fy = -1;
-            find_walkable_point_in_cell(m, obs_pos, ix + 0.5, iy + 0.5, fx2, fy2, &fx, &fy);
-            if(fx >= 0 && fy >= 0) {
-                push_fpos(L, fx, fy, num++);
-            }
-        }
-    }
-    push_fpos(L, fx2, fy2, num++);
-}
-
-static int insert_mid_jump_point(Map* m, int cur, int father) {
-    int w = m->width;
-    int dx = cur % w - father % w;
-    int dy = cur / w - father / w;
-    if (dx == 0 || dy == 0) {
-        return 0;
-    }
-    if (dx < 0) {
-        dx = -dx;
-    }
-    if (dy < 0) {
-        dy = -dy;
-    }
-    if (dx == dy) {
-        return 0;
-    }
-    int span = dx;
-    if (dy < dx) {
-        span = dy;
-    }
-    int mx = 0, my = 0;
-    if (cur % w < father % w && cur / w < father / w) {
-        mx = father % w - span;
-        my = father / w - span;
-    } else if (cur % w < father % w && cur / w > father / w) {
-        mx = father % w - span;
-        my = father / w + span;
-    } else if (cur % w > father % w && cur / w < father / w) {
-        mx = father % w + span;
-        my = father / w - span;
-    } else if (cur % w > father % w && cur / w > father / w) {
-        mx = father % w + span;
-        my = father / w + span;
-    }
-    push_pos_to_ipath(m, xy2pos(m, mx, my));
-    return 1;
-}
-
-static void flood_mark(struct map *m, int pos, int connected_num, int limit) {
-    char *visited = m->visited;
-    if (visited[pos]) {
-        return;
-    }
-    int *queue = m->queue;
-    memset(queue, 0, limit * sizeof(int));
-    int pop_i = 0, push_i = 0;
-    visited[pos] = 1;
-    m->connected[pos] = connected_num;
-    queue[push_i++] = pos;
-
-#define CHECK_POS(n) do { \
-    if (!BITTEST(m->m, n)) { \
-        if (!visited[n]) { \
-            visited[n] = 1; \
-            m->connected[n] = connected_num; \
-            queue[push_i++] = n; \
-        } \
-    } \
-} while(0);
-    int cur, left;
-    while (pop_i < push_i) {
-        cur = queue[pop_i++];
-        left = cur % m->width;
-        if (left != 0) {
-            CHECK_POS(cur - 1);
-        }
-        if (left != m->width - 1) {
-            CHECK_POS(cur + 1);
-        }
-        if (cur >= m->width) {
-            CHECK_POS(cur - m->width);
-        }
-        if (cur < limit - m->width) {
-            CHECK_POS(cur + m->width);
-        }
+static void push_path_to_fstack(lua_State* L, const float* path, int n) {
+    lua_createtable(L, n, 0);
+    int i;
+    for (i = 0; i < n; i++) {
+        push_fpos(L, path[2 * i], path[2 * i + 1], i + 1);
     }
-#undef CHECK_POS
 }
 
 static int lnav_add_block(lua_State* L) {
@@ -208,7 +79,7 @@ static int lnav_add_block(lua_State* L) {
     if (!check_in_map(x, y, m->width, m->height)) {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
     }
-    BITSET(m->m, m->width * y + x);
+    map_set_block(m, m->width * y + x);
     return 0;
 }
 
@@ -216,7 +87,7 @@ static int lnav_is_block(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
     int x = luaL_checkinteger(L, 2);
     int y = luaL_checkinteger(L, 3);
-    int block = BITTEST(m->m, m->width * y + x);
+    int block = map_blocked(m, m->width * y + x);
     lua_pushboolean(L, block);
     return 1;
 }
@@ -225,7 +96,7 @@ static int lnav_get_connected_id(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
     int x = luaL_checkinteger(L, 2);
     int y = luaL_checkinteger(L, 3);
-    lua_pushnumber(L, m->connected[m->width * y + x]);
+    lua_pushnumber(L, map_connected_id(m, m->width * y + x));
     return 1;
 }
 
@@ -233,7 +104,10 @@ static int lnav_set_connected_id(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
     int x = luaL_checkinteger(L, 2);
     int y = luaL_checkinteger(L, 3);
-    int connected_id = luaL_checkinteger(L, 4);
+    lua_Integer connected_id = luaL_checkinteger(L, 4);
+    // 区域数不会超过格子数, 超出范围的 id 会让并查集越界或者无限扩容
+    luaL_argcheck(L, connected_id >= 0 && connected_id <= (lua_Integer)m->width * m->height, 4,
+                  "connected id out of range");
     
     if (!check_in_map(x, y, m->width, m->height)) {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
@@ -243,10 +117,7 @@ static int lnav_set_connected_id(lua_State* L) {
         luaL_error(L, "Map has not been marked for connected areas");
     }
     
-    m->connected[m->width * y + x] = connected_id;
-    if (connected_id > m->mark_connected) {
-        m->mark_connected = connected_id;
-    }
+    map_set_connected_id(m, m->width * y + x, connected_id);
     return 0;
 }
 
@@ -281,36 +152,63 @@ static int lnav_clear_block(lua_State* L) {
     if (!check_in_map(x, y, m->width, m->height)) {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
     }
-    BITCLEAR(m->m, m->width * y + x);
+    map_clear_block(m, m->width * y + x);
     return 0;
 }
 
 static int lnav_clear_allblock(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
-    int i;
-    for (i = 0; i < m->width * m->height; i++) {
-        BITCLEAR(m->m, i);
-    }
+    map_clear_allblock(m);
     return 0;
 }
 
+// 可选参数为线程数, 大于 1 时多线程标记
 static int lnav_mark_connected(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
+    int nthreads = luaL_optinteger(L, 2, 1);
+    if (nthreads > 1) {
+        map_mark_connected_parallel(m, nthreads);
+    } else {
+        map_mark_connected(m);
+    }
+    return 0;
+}
 
-    // m->mark_connected = 1;
-    int len = m->width * m->height;
-    memset(m->connected, 0, len * sizeof(int));
-    memset(m->visited, 0, len * sizeof(char));
-    int i, connected_num = 0;
-    for (i = 0; i < len; i++) {
-        if (!m->visited[i] && !BITTEST(m->m, i)) {
-            flood_mark(m, i, ++connected_num, len);
-        }
+static int remark_block(lua_State* L, int block) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    int x = luaL_checkinteger(L, 2);
+    int y = luaL_checkinteger(L, 3);
+    if (!check_in_map(x, y, m->width, m->height)) {
+        luaL_error(L, "Position (%d,%d) is out of map", x, y);
+    }
+    if (!m->mark_connected) {
+        luaL_error(L, "Map has not been marked for connected areas");
+    }
+    int pos = m->width * y + x;
+    int changed[4];
+    int i, n;
+    if (block) {
+        map_set_block(m, pos);
+        n = map_remark_add_block(m, pos, changed);
+    } else {
+        map_clear_block(m, pos);
+        n = map_remark_clear_block(m, pos, changed);
     }
+    lua_createtable(L, n, 0);
+    for (i = 0; i < n; i++) {
+        lua_pushinteger(L, changed[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
 
-    m->mark_connected = connected_num;
+// 加阻挡并增量更新连通区域, 返回 id 有变化的区域列表
+static int lnav_add_block_and_remark(lua_State* L) {
+    return remark_block(L, 1);
+}
 
-    return 0;
+static int lnav_clear_block_and_remark(lua_State* L) {
+    return remark_block(L, 0);
 }
 
 static int lnav_dump_connected(lua_State* L) {
@@ -322,7 +220,7 @@ static int lnav_dump_connected(lua_State* L) {
     }
     int i;
     for (i = 0; i < m->width * m->height; i++) {
-        int mark = m->connected[i];
+        int mark = map_connected_id(m, i);
         if (mark > 0) {
             printf("%d ", mark);
         } else {
@@ -347,15 +245,15 @@ static int lnav_dump(lua_State* L) {
             pos = 0;
         }
         int mark = 0;
-        if (BITTEST(m->m, i)) {
+        if (map_blocked(m, i)) {
             s[pos++] = '*';
             mark = 1;
         }
-        if (i == m->start) {
+        if (i == m->ctx.start) {
             s[pos++] = 'S';
             mark = 1;
         }
-        if (i == m->end) {
+        if (i == m->ctx.end) {
             s[pos++] = 'E';
             mark = 1;
         }
@@ -374,26 +272,16 @@ static int lnav_dump(lua_State* L) {
 
 static int gc(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
-    free(m->comefrom);
-    free(m->open_set_map);
-    if (m->mark_connected) {
-        free(m->connected);
+    if (m->pool) {
+        path_pool_destroy(m->pool);
+        m->pool = NULL;
     }
-    free(m->queue);
-    free(m->visited);
-    return 0;
-}
-
-static void form_ipath(Map* m, int last) {
-    int pos = last;
-    m->ipath_len = 0;
-
-    while (m->comefrom[pos] != -1) {
-        push_pos_to_ipath(m, pos);
-        insert_mid_jump_point(m, pos, m->comefrom[pos]);
-        pos = m->comefrom[pos];
+    if (m->graph) {
+        graph_free(m->graph);
+        m->graph = NULL;
     }
-    push_pos_to_ipath(m, m->start);
+    map_destroy(m);
+    return 0;
 }
 
 static int lnav_check_line_walkable(lua_State* L) {
@@ -406,94 +294,551 @@ static int lnav_check_line_walkable(lua_State* L) {
     return 1;
 }
 
+static void check_fpos(lua_State* L, Map* m, float fx, float fy) {
+    int x = fx;
+    int y = fy;
+    if (!check_in_map(x, y, m->width, m->height)) {
+        luaL_error(L, "Position (%d,%d) is out of map", x, y);
+    }
+}
+
+// 平滑方式 "none"/"full"/"linear", 下标与 SMOOTH_* 一致, 默认 "full"
+static int check_smooth(lua_State* L, int arg) {
+    static const char* const names[] = {"none", "full", "linear", NULL};
+    return luaL_checkoption(L, arg, "full", names);
+}
+
+/*
+    寻路方式 "jps"/"theta"/"bidir", 下标与 SEARCH_* 一致, 缺省时为 def(地图上 set_search 设置的).
+    find_path 等接口的最后一个可选参数, 只对本次寻路生效
+*/
+static const char* const search_names[] = {"jps", "theta", "bidir", NULL};
+
+static int check_search(lua_State* L, int arg, int def) {
+    return luaL_checkoption(L, arg, search_names[def], search_names);
+}
+
 static int lnav_find_path(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
     float fx1 = luaL_checknumber(L, 2);
     float fy1 = luaL_checknumber(L, 3);
-    int x = fx1;
-    int y = fy1;
-    if (check_in_map(x, y, m->width, m->height)) {
-        m->start = m->width * y + x;
-    } else {
-        luaL_error(L, "Position (%d,%d) is out of map", x, y);
-    }
+    check_fpos(L, m, fx1, fy1);
     float fx2 = luaL_checknumber(L, 4);
     float fy2 = luaL_checknumber(L, 5);
-    x = fx2;
-    y = fy2;
-    if (check_in_map(x, y, m->width, m->height)) {
-        m->end = m->width * y + x;
-    } else {
-        luaL_error(L, "Position (%d,%d) is out of map", x, y);
-    }
-    if(floor(fx1) == floor(fx2) && floor(fy1) == floor(fy2)) {
-        lua_newtable(L);
-        push_fpos(L, fx1, fy1, 1);
-        push_fpos(L, fx2, fy2, 2);
+    check_fpos(L, m, fx2, fy2);
+    SearchContext* s = &m->ctx;
+    int smooth = check_smooth(L, 6);
+    int search = s->search;
+    s->search = check_search(L, 7, search);
+    int n = find_fpath(m, s, fx1, fy1, fx2, fy2, smooth);
+    s->search = search;
+    if (n > 0) {
+        push_path_to_fstack(L, s->fpath, s->fpath_len);
+        // 展开节点数超过 set_max_expanded 的上限时是到最接近终点处的部分路径, 多返回一个 true
+        if (s->partial) {
+            lua_pushboolean(L, 1);
+            return 2;
+        }
         return 1;
     }
-    if (BITTEST(m->m, m->start)) {
-        // luaL_error(L, "start pos(%d,%d) is in block", m->start % m->width,
-        //            m->start / m->width);
-        return 0;
+    return 0;
+}
+
+/*
+    与 find_path 相同, 但把路点按 x1, y1, x2, y2 ... 平铺写进调用方传入的 buf,
+    返回路点数, 找不到路径返回 0, 是部分路径时与 find_path 一样多返回一个 true.
+    buf[2n+1] 会被置为 nil, 其后的旧数据不清理. buf 可以反复使用, 数组部分够大之后不再产生任何分配
+*/
+static int lnav_find_path_into(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    float fx1 = luaL_checknumber(L, 3);
+    float fy1 = luaL_checknumber(L, 4);
+    check_fpos(L, m, fx1, fy1);
+    float fx2 = luaL_checknumber(L, 5);
+    float fy2 = luaL_checknumber(L, 6);
+    check_fpos(L, m, fx2, fy2);
+    SearchContext* s = &m->ctx;
+    int smooth = check_smooth(L, 7);
+    int search = s->search;
+    s->search = check_search(L, 8, search);
+    int n = find_fpath(m, s, fx1, fy1, fx2, fy2, smooth);
+    s->search = search;
+    int i;
+    for (i = 0; i < n * 2; i++) {
+        lua_pushnumber(L, s->fpath[i]);
+        lua_rawseti(L, 2, i + 1);
     }
-    if (BITTEST(m->m, m->end)) {
-        // luaL_error(L, "end pos(%d,%d) is in block", m->end % m->width,
-        //            m->end / m->width);
-        return 0;
+    lua_pushnil(L);
+    lua_rawseti(L, 2, n * 2 + 1);
+    lua_pushinteger(L, n);
+    if (n > 0 && s->partial) {
+        lua_pushboolean(L, 1);
+        return 2;
     }
-    if (m->connected[m->start] != m->connected[m->end]) {
-        return 0;
+    return 1;
+}
+
+static float getnumber(lua_State* L, int i) {
+    if (lua_geti(L, -1, i) != LUA_TNUMBER) {
+        luaL_error(L, "invalid path query, number expected at %d", i);
     }
-    int start_pos = jps_find_path(m);
-    if (start_pos >= 0) {
-        form_ipath(m, start_pos);
-        smooth_path(m);
-        push_path_to_fstack(L, m, fx1, fy1, fx2, fy2);
-        return 1;
+    float v = lua_tonumber(L, -1);
+    lua_pop(L, 1);
+    return v;
+}
+
+static void get_path_query(lua_State* L, Map* m, int i, struct path_query* q) {
+    if (lua_rawgeti(L, 2, i) != LUA_TTABLE) {
+        luaL_error(L, "invalid path query %d", i);
     }
-    return 0;
+    q->fx1 = getnumber(L, 1);
+    q->fy1 = getnumber(L, 2);
+    q->fx2 = getnumber(L, 3);
+    q->fy2 = getnumber(L, 4);
+    lua_pop(L, 1);
+    check_fpos(L, m, q->fx1, q->fy1);
+    check_fpos(L, m, q->fx2, q->fy2);
+}
+
+/*
+    批量寻路, batch 为 {{x1, y1, x2, y2}, ...}, 返回同样长度的数组,
+    每项是 find_path 的结果, 找不到路径时为 false. 有查询超过 set_max_expanded 的上限时
+    多返回一个表, 以这些查询的下标为键, 值为 true, 对应的结果是部分路径.
+    所有查询共用同一份寻路缓存, 起点终点不连通的直接跳过.
+    用 set_threads 开启线程池后, 查询会分给各线程并发执行, 全部完成后再统一生成结果
+*/
+static int lnav_find_paths(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    lua_settop(L, 2);
+    int n = lua_rawlen(L, 2);
+    int i, count, partial, has_partial = 0;
+    const float* path;
+    if (m->pool) {
+        struct path_query* queries = path_pool_queries(m->pool, n);
+        for (i = 1; i <= n; i++) {
+            get_path_query(L, m, i, &queries[i - 1]);
+        }
+        path_pool_run(m->pool);
+    }
+    lua_createtable(L, n, 0);
+    for (i = 1; i <= n; i++) {
+        if (m->pool) {
+            path = path_pool_result(m->pool, i - 1, &count, &partial);
+        } else {
+            struct path_query q;
+            get_path_query(L, m, i, &q);
+            count = find_fpath(m, &m->ctx, q.fx1, q.fy1, q.fx2, q.fy2, SMOOTH_FULL);
+            path = m->ctx.fpath;
+            partial = count > 0 && m->ctx.partial;
+        }
+        if (count > 0) {
+            push_path_to_fstack(L, path, count);
+        } else {
+            lua_pushboolean(L, 0);
+        }
+        lua_rawseti(L, 3, i);
+        if (partial) {
+            // 部分路径的下标记在第 4 个栈位置的表里, 没有部分路径时不创建
+            if (!has_partial) {
+                lua_newtable(L);
+                has_partial = 1;
+            }
+            lua_pushboolean(L, 1);
+            lua_rawseti(L, 4, i);
+        }
+    }
+    return has_partial ? 2 : 1;
 }
 
 static int lnav_find_path_by_grid(lua_State* L) {
     Map* m = luaL_checkudata(L, 1, MT_NAME);
+    SearchContext* s = &m->ctx;
     int x = luaL_checkinteger(L, 2);
     int y = luaL_checkinteger(L, 3);
     if (check_in_map(x, y, m->width, m->height)) {
-        m->start = m->width * y + x;
+        s->start = m->width * y + x;
     } else {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
     }
     x = luaL_checkinteger(L, 4);
     y = luaL_checkinteger(L, 5);
     if (check_in_map(x, y, m->width, m->height)) {
-        m->end = m->width * y + x;
+        s->end = m->width * y + x;
     } else {
         luaL_error(L, "Position (%d,%d) is out of map", x, y);
     }
-    if (BITTEST(m->m, m->start)) {
-        luaL_error(L, "start pos(%d,%d) is in block", m->start % m->width,
-                   m->start / m->width);
+    if (map_blocked(m, s->start)) {
+        luaL_error(L, "start pos(%d,%d) is in block", s->start % m->width,
+                   s->start / m->width);
         return 0;
     }
-    if (BITTEST(m->m, m->end)) {
-        luaL_error(L, "end pos(%d,%d) is in block", m->end % m->width,
-                   m->end / m->width);
+    if (map_blocked(m, s->end)) {
+        luaL_error(L, "end pos(%d,%d) is in block", s->end % m->width,
+                   s->end / m->width);
         return 0;
     }
-    int without_smooth = lua_toboolean(L, 6);
-    int start_pos = jps_find_path(m);
-    if (start_pos >= 0) {
-        form_ipath(m, start_pos);
-        if (!without_smooth) {
-            smooth_path(m);
-        }
+    // 第 6 个参数兼容旧用法, 传 true 表示不平滑
+    int smooth = lua_isboolean(L, 6) ? (lua_toboolean(L, 6) ? SMOOTH_NONE : SMOOTH_FULL)
+                                     : check_smooth(L, 6);
+    int search = s->search;
+    s->search = check_search(L, 7, search);
+    int found = search_ipath(m, s);
+    if (found) {
+        smooth_ipath(m, s, s->search == SEARCH_THETA ? SMOOTH_NONE : smooth);
+    }
+    s->search = search;
+    if (found) {
         push_path_to_istack(L, m);
+        if (s->partial) {
+            lua_pushboolean(L, 1);
+            return 2;
+        }
         return 1;
     }
     return 0;
 }
 
+static int lnav_set_open_list(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    static const char* const names[] = {"fibheap", "dheap", NULL};
+    m->ctx.open_list = luaL_checkoption(L, 2, NULL, names);
+    return 0;
+}
+
+// 一次寻路最多展开的节点数, 超过时返回到最接近终点处的部分路径, 0 表示不限
+static int lnav_set_max_expanded(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    int n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "negative limit");
+    m->ctx.max_expanded = n;
+    return 0;
+}
+
+/*
+    默认的寻路方式: "jps" 跳点寻路加平滑, "theta" 任意角度寻路(Lazy Theta*), 不走分层寻路也不再平滑,
+    "bidir" 双向跳点寻路加平滑, 不走分层寻路. 单次寻路用别的方式时传给 find_path 等的最后一个参数
+*/
+static int lnav_set_search(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    m->ctx.search = luaL_checkoption(L, 2, NULL, search_names);
+    return 0;
+}
+
+// 开启或关闭分层寻路, 可选参数为簇的边长
+static int lnav_set_hpa(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    if (lua_toboolean(L, 2)) {
+        int size = luaL_optinteger(L, 3, HPA_CLUSTER_SIZE);
+        luaL_argcheck(L, size >= 8, 3, "cluster size too small");
+        hpa_build(m, size);
+    } else {
+        hpa_free(m);
+    }
+    return 0;
+}
+
+// 设置批量寻路的线程数(包括调用线程), 小于等于 1 时关闭线程池
+static int lnav_set_threads(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    int n = luaL_checkinteger(L, 2);
+    if (m->pool) {
+        path_pool_destroy(m->pool);
+        m->pool = NULL;
+    }
+    if (n > 1) {
+        m->pool = path_pool_create(m, n);
+    }
+    return 0;
+}
+
+static int lnav_set_jps_plus(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    if (lua_toboolean(L, 2)) {
+        jps_plus_build(m);
+    } else {
+        jps_plus_free(m);
+    }
+    return 0;
+}
+
+// 开启或关闭 64x64 分块统计, 开阔地图上跳点扫描和视线检测可以整块跨过
+static int lnav_set_tiles(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    if (lua_toboolean(L, 2)) {
+        tiles_build(m);
+    } else {
+        tiles_free(m);
+    }
+    return 0;
+}
+
+static struct graph* get_graph(Map* m) {
+    if (!m->graph) {
+        m->graph = graph_new();
+    }
+    return m->graph;
+}
+
+static int check_graph_node(lua_State* L, struct graph* g, int arg) {
+    int id = luaL_checkinteger(L, arg);
+    luaL_argcheck(L, graph_valid(g, id), arg, "invalid graph node");
+    return id;
+}
+
+// 加一个连接点, 返回节点 id
+static int lnav_graph_add_node(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    float x = luaL_checknumber(L, 2);
+    float y = luaL_checknumber(L, 3);
+    int area = luaL_checkinteger(L, 4);
+    lua_pushinteger(L, graph_add_node(get_graph(m), x, y, area));
+    return 1;
+}
+
+static int lnav_graph_del_node(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct graph* g = get_graph(m);
+    graph_del_node(g, check_graph_node(L, g, 2));
+    return 0;
+}
+
+static int lnav_graph_set_area(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct graph* g = get_graph(m);
+    int id = check_graph_node(L, g, 2);
+    g->nodes[id].area = luaL_checkinteger(L, 3);
+    return 0;
+}
+
+static int lnav_graph_set_disabled(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct graph* g = get_graph(m);
+    int id = check_graph_node(L, g, 2);
+    g->nodes[id].disabled = lua_toboolean(L, 3);
+    return 0;
+}
+
+static int lnav_graph_connect(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct graph* g = get_graph(m);
+    int a = check_graph_node(L, g, 2);
+    int b = check_graph_node(L, g, 3);
+    float weight = luaL_checknumber(L, 4);
+    luaL_argcheck(L, weight >= 0, 4, "negative weight");
+    graph_connect(g, a, b, weight);
+    return 0;
+}
+
+static int lnav_graph_disconnect(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct graph* g = get_graph(m);
+    int a = check_graph_node(L, g, 2);
+    int b = check_graph_node(L, g, 3);
+    graph_disconnect(g, a, b);
+    return 0;
+}
+
+/*
+    graph_find_path(sx, sy, src_area, dx, dy, dst_area)
+    返回起点到终点依次经过的连接点 id 数组, 找不到时返回 nil
+*/
+static int lnav_graph_find_path(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    float sx = luaL_checknumber(L, 2);
+    float sy = luaL_checknumber(L, 3);
+    int src_area = luaL_checkinteger(L, 4);
+    float dx = luaL_checknumber(L, 5);
+    float dy = luaL_checknumber(L, 6);
+    int dst_area = luaL_checkinteger(L, 7);
+    struct graph* g = get_graph(m);
+    int n = graph_find_path(g, sx, sy, src_area, dx, dy, dst_area);
+    if (n < 0) {
+        return 0;
+    }
+    lua_createtable(L, n, 0);
+    int i;
+    for (i = 0; i < n; i++) {
+        lua_pushinteger(L, g->path[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+// 把地图保存成快照, 失败时返回 nil 和错误信息
+static int lnav_save_snapshot(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    const char* path = luaL_checkstring(L, 2);
+    const char* err = snapshot_save(m, path);
+    if (err) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+/*
+    把网格共享给别的 lua_State: 返回的 lightuserdata 传过去后用 navigation.c.attach 接收,
+    每次 share 都要对应一次 attach, 否则网格不会释放
+*/
+static int lnav_share(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    lua_pushlightuserdata(L, map_share(m));
+    return 1;
+}
+
+static void push_bytes(lua_State* L, const char* name, size_t bytes, size_t* total) {
+    lua_pushinteger(L, bytes);
+    lua_setfield(L, -2, name);
+    *total += bytes;
+}
+
+/*
+    各部分占用的字节数, total 为总和. 网格(bitmap, transposed, connected, jump_table)
+    被多个 lua_State 共享时 shared 为 true, 这几项只占一份内存
+*/
+static int lnav_memory_usage(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    size_t len = m->width * m->height, total = 0;
+    lua_newtable(L);
+    push_bytes(L, "bitmap", BITMAP_LEN(m->width, m->height), &total);
+    push_bytes(L, "transposed", BITMAP_LEN(m->width, m->height), &total);
+    push_bytes(L, "connected", len * map_label_size(m), &total);
+    push_bytes(L, "union_find", m->uf_cap * sizeof(int), &total);
+    push_bytes(L, "search", search_ctx_memory(&m->ctx), &total);
+    push_bytes(L, "connectivity", m->queue ? len * (sizeof(int) + sizeof(char)) : 0, &total);
+    push_bytes(L, "jump_table", m->jump_table ? len * 8 : 0, &total);
+    push_bytes(L, "hpa", hpa_memory(m), &total);
+    push_bytes(L, "tiles", tiles_memory(m), &total);
+    push_bytes(L, "graph", m->graph ? graph_memory(m->graph) : 0, &total);
+    push_bytes(L, "pool", m->pool ? path_pool_memory(m->pool) : 0, &total);
+    lua_pushinteger(L, total);
+    lua_setfield(L, -2, "total");
+    lua_pushboolean(L, __atomic_load_n(&m->grid->ref, __ATOMIC_ACQUIRE) > 1);
+    lua_setfield(L, -2, "shared");
+    return 1;
+}
+
+/*
+    分步寻路的句柄, 持有自己的寻路缓冲, 一次寻路可以分摊到多帧推进, 不影响地图上的其它寻路.
+    第一个 user value 引用地图, 句柄存活期间地图不会被回收
+*/
+struct search_handle {
+    Map* m;
+    SearchContext ctx;
+    int status; // 最近一次 search_begin / search_step 的返回值
+    int started;
+    float fx1, fy1, fx2, fy2;
+};
+
+static int push_search_status(lua_State* L, int status) {
+    lua_pushstring(L, status >= 0 ? "found" : (status == SEARCH_PENDING ? "pending" : "none"));
+    return 1;
+}
+
+/*
+    h:start(x1, y1, x2, y2 [, search]) 开始一次寻路, 沿用地图当前的开放列表,
+    寻路方式缺省时也沿用地图的, 返回 "found" / "pending" / "none"
+*/
+static int lsearch_start(lua_State* L) {
+    struct search_handle* h = luaL_checkudata(L, 1, SEARCH_MT_NAME);
+    Map* m = h->m;
+    float fx1 = luaL_checknumber(L, 2);
+    float fy1 = luaL_checknumber(L, 3);
+    check_fpos(L, m, fx1, fy1);
+    float fx2 = luaL_checknumber(L, 4);
+    float fy2 = luaL_checknumber(L, 5);
+    check_fpos(L, m, fx2, fy2);
+    int search = check_search(L, 6, m->ctx.search);
+    h->fx1 = fx1;
+    h->fy1 = fy1;
+    h->fx2 = fx2;
+    h->fy2 = fy2;
+    h->ctx.open_list = m->ctx.open_list;
+    h->ctx.search = search;
+    h->status = search_begin(m, &h->ctx, fx1, fy1, fx2, fy2);
+    h->started = 1;
+    return push_search_status(L, h->status);
+}
+
+// h:step(n [, us]) 继续寻路, 最多展开 n 个节点(0 表示不限), 给了 us 时最多用 us 微秒, 返回值同 start
+static int lsearch_step(lua_State* L) {
+    struct search_handle* h = luaL_checkudata(L, 1, SEARCH_MT_NAME);
+    int n = luaL_checkinteger(L, 2);
+    int us = luaL_optinteger(L, 3, 0);
+    luaL_argcheck(L, h->started, 1, "search not started");
+    if (h->status == SEARCH_PENDING) {
+        h->status = search_step(h->m, &h->ctx, n, us);
+    }
+    return push_search_status(L, h->status);
+}
+
+/*
+    h:path([smooth]) 找到时返回完整路径, 还没搜完时返回到目前最接近终点处的部分路径和 true,
+    没有路径时返回 nil. 取部分路径之后仍然可以继续 step
+*/
+static int lsearch_path(lua_State* L) {
+    struct search_handle* h = luaL_checkudata(L, 1, SEARCH_MT_NAME);
+    int smooth = check_smooth(L, 2);
+    SearchContext* s = &h->ctx;
+    if (h->started && search_fpath(h->m, s, h->status, h->fx1, h->fy1, h->fx2, h->fy2, smooth) > 0) {
+        push_path_to_fstack(L, s->fpath, s->fpath_len);
+        if (s->partial) {
+            lua_pushboolean(L, 1);
+            return 2;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// 本次寻路到目前为止展开的节点数
+static int lsearch_expanded(lua_State* L) {
+    struct search_handle* h = luaL_checkudata(L, 1, SEARCH_MT_NAME);
+    lua_pushinteger(L, h->started ? h->ctx.expanded : 0);
+    return 1;
+}
+
+static int lsearch_gc(lua_State* L) {
+    struct search_handle* h = luaL_checkudata(L, 1, SEARCH_MT_NAME);
+    search_ctx_destroy(&h->ctx);
+    return 0;
+}
+
+static int lsearch_metatable(lua_State* L) {
+    if (luaL_newmetatable(L, SEARCH_MT_NAME)) {
+        luaL_Reg l[] = {{"start", lsearch_start},
+                        {"step", lsearch_step},
+                        {"path", lsearch_path},
+                        {"expanded", lsearch_expanded},
+                        {NULL, NULL}};
+        luaL_newlib(L, l);
+        lua_setfield(L, -2, "__index");
+
+        lua_pushcfunction(L, lsearch_gc);
+        lua_setfield(L, -2, "__gc");
+    }
+    return 1;
+}
+
+// 创建分步寻路的句柄, 同一个句柄可以反复 start
+static int lnav_new_search(lua_State* L) {
+    Map* m = luaL_checkudata(L, 1, MT_NAME);
+    struct search_handle* h = lua_newuserdatauv(L, sizeof(struct search_handle), 1);
+    h->m = m;
+    search_ctx_init(&h->ctx, m->width * m->height);
+    h->status = SEARCH_NONE;
+    h->started = 0;
+    lua_pushvalue(L, 1);
+    lua_setiuservalue(L, -2, 1);
+    lsearch_metatable(L);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
 static int lmetatable(lua_State* L) {
     if (luaL_newmetatable(L, MT_NAME)) {
         luaL_Reg l[] = {{"add_block", lnav_add_block},
@@ -503,12 +848,34 @@ static int lmetatable(lua_State* L) {
                         {"is_block", lnav_is_block},
                         {"find_path_by_grid", lnav_find_path_by_grid},
                         {"find_path", lnav_find_path},
+                        {"find_path_into", lnav_find_path_into},
+                        {"find_paths", lnav_find_paths},
                         {"find_line_obstacle", lnav_check_line_walkable},
                         {"get_connected_id", lnav_get_connected_id},
                         {"set_connected_id", lnav_set_connected_id},
                         {"get_max_connected_id", lnav_get_max_connected_id},
                         {"mark_connected", lnav_mark_connected},
+                        {"add_block_and_remark", lnav_add_block_and_remark},
+                        {"clear_block_and_remark", lnav_clear_block_and_remark},
+                        {"set_open_list", lnav_set_open_list},
+                        {"set_search", lnav_set_search},
+                        {"set_max_expanded", lnav_set_max_expanded},
+                        {"new_search", lnav_new_search},
+                        {"set_jps_plus", lnav_set_jps_plus},
+                        {"set_hpa", lnav_set_hpa},
+                        {"set_threads", lnav_set_threads},
+                        {"set_tiles", lnav_set_tiles},
+                        {"graph_add_node", lnav_graph_add_node},
+                        {"graph_del_node", lnav_graph_del_node},
+                        {"graph_set_area", lnav_graph_set_area},
+                        {"graph_set_disabled", lnav_graph_set_disabled},
+                        {"graph_connect", lnav_graph_connect},
+                        {"graph_disconnect", lnav_graph_disconnect},
+                        {"graph_find_path", lnav_graph_find_path},
                         {"dump_connected", lnav_dump_connected},
+                        {"save_snapshot", lnav_save_snapshot},
+                        {"share", lnav_share},
+                        {"memory_usage", lnav_memory_usage},
                         {"dump", lnav_dump},
                         {NULL, NULL}};
         luaL_newlib(L, l);
@@ -526,12 +893,9 @@ static int lnewmap(lua_State* L) {
     int width = getfield(L, "w");
     int height = getfield(L, "h");
     lua_assert(width > 0 && height > 0);
-    int len = width * height;
-
-    int map_men_len = (BITSLOT(len) + 1) * 2;
 
-    Map* m = lua_newuserdata(L, sizeof(Map) + map_men_len * sizeof(m->m[0]));
-    init_map(m, width, height, map_men_len);
+    Map* m = lua_newuserdata(L, sizeof(Map));
+    init_map(m, width, height);
     if (lua_getfield(L, 1, "obstacle") == LUA_TTABLE) {
         int i = 1;
         while (lua_geti(L, -1, i) == LUA_TTABLE) {
@@ -551,10 +915,40 @@ static int lnewmap(lua_State* L) {
     return 1;
 }
 
+// 从快照加载地图, 数据直接映射文件, 不需要重新设置阻挡和标记连通区域
+static int lloadmap(lua_State* L) {
+    const char* path = luaL_checkstring(L, 1);
+    Map* m = lua_newuserdata(L, sizeof(Map));
+    const char* err = snapshot_load(m, path);
+    if (err) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    lmetatable(L);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
+// 接收 share 得到的网格, 只复制连通区域的并查集, 寻路用的缓冲各自分配
+static int lattachmap(lua_State* L) {
+    luaL_checktype(L, 1, LUA_TLIGHTUSERDATA);
+    struct grid_share* share = lua_touserdata(L, 1);
+    Map* m = lua_newuserdata(L, sizeof(Map));
+    if (!map_attach(m, share)) {
+        return luaL_error(L, "invalid share: each share can be attached only once");
+    }
+    lmetatable(L);
+    lua_setmetatable(L, -2);
+    return 1;
+}
+
 LUAMOD_API int luaopen_navigation_c(lua_State* L) {
     luaL_checkversion(L);
     luaL_Reg l[] = {
         {"new", lnewmap},
+        {"load", lloadmap},
+        {"attach", lattachmap},
         {NULL, NULL},
     };
     luaL_newlib(L, l);
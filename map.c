@@ -1,36 +1,404 @@
 
+#include <pthread.h>
 #include "map.h"
+#include "connected.h"
+#include "hpa.h"
+#include "jps.h"
+#include "snapshot.h"
+#include "tile.h"
 
-void push_pos_to_ipath(Map* m, int ipos) {
-    m->ipath_len++;
-    if (m->ipath_len > m->ipath_cap) {
-        int* old_path = m->ipath;
-        m->ipath_cap *= 2;
-        m->ipath = (int*)malloc(sizeof(int) * m->ipath_cap);
-        memcpy(m->ipath, old_path, sizeof(int) * (m->ipath_len - 1));
+void push_pos_to_ipath(SearchContext* s, int ipos) {
+    s->ipath_len++;
+    if (s->ipath_len > s->ipath_cap) {
+        int* old_path = s->ipath;
+        s->ipath_cap *= 2;
+        s->ipath = (int*)malloc(sizeof(int) * s->ipath_cap);
+        memcpy(s->ipath, old_path, sizeof(int) * (s->ipath_len - 1));
         free(old_path);
     }
-    m->ipath[m->ipath_len - 1] = ipos;
-    // printf("add pos to ipath %d\n", m->ipath[m->ipath_len - 1]);
+    s->ipath[s->ipath_len - 1] = ipos;
+    // printf("add pos to ipath %d\n", s->ipath[s->ipath_len - 1]);
 }
 
-void init_map(Map* m, int width, int height, int map_men_len) {
+void search_ctx_init(SearchContext* s, int len) {
+    s->start = -1;
+    s->end = -1;
+    s->len = len;
+    s->comefrom = NULL;
+    s->open_set_map = NULL;
+    s->gen = NULL;
+    s->search_gen = 0;
+    arena_init(&s->arena);
+    s->open_list = OPEN_LIST_FIBHEAP;
+    dheap_init(&s->open_heap);
+    s->expanded = 0;
+    s->search = SEARCH_JPS;
+    s->cell_g = NULL;
+    s->open_set = NULL;
+    s->max_expanded = 0;
+    s->closest = -1;
+    s->closest_h = 0;
+    s->partial = 0;
+    s->reverse = NULL;
+    s->other = NULL;
+    s->meet = -1;
+    s->meet_from = -1;
+    s->meet_g = INT_MAX;
+    s->mark = NULL;
+    s->tmark = NULL;
+    s->mark_len = 0;
+    s->marked = NULL;
+    s->nmarked = 0;
+    s->marked_cap = 0;
+    s->ipath_cap = 2;
+    s->ipath_len = 0;
+    s->ipath = (int*)malloc(s->ipath_cap * sizeof(int));
+    s->fpath_cap = 16;
+    s->fpath_len = 0;
+    s->fpath = (float*)malloc(s->fpath_cap * 2 * sizeof(float));
+    s->hpa_scratch = NULL;
+}
+
+void search_ctx_prepare(SearchContext* s) {
+    if (s->gen) {
+        return;
+    }
+    s->comefrom = (int*)malloc(s->len * sizeof(int));
+    s->open_set_map =
+        (struct heap_node**)malloc(s->len * sizeof(struct heap_node*));
+    s->gen = (unsigned int*)calloc(s->len, sizeof(unsigned int));
+    s->search_gen = 0;
+}
+
+void search_ctx_prepare_cell_g(SearchContext* s) {
+    if (!s->cell_g) {
+        s->cell_g = (int*)malloc(s->len * sizeof(int));
+    }
+}
+
+size_t search_ctx_memory(const SearchContext* s) {
+    size_t bytes = s->ipath_cap * sizeof(int) + s->fpath_cap * 2 * sizeof(float);
+    if (s->gen) {
+        bytes += s->len * (sizeof(int) + sizeof(struct heap_node*) + sizeof(unsigned int));
+    }
+    if (s->cell_g) {
+        bytes += s->len * sizeof(int);
+    }
+    bytes += arena_memory(&s->arena);
+    bytes += s->open_heap.cap * sizeof(struct node_data*);
+    if (s->hpa_scratch) {
+        bytes += hpa_scratch_memory(s->hpa_scratch);
+    }
+    if (s->reverse) {
+        bytes += sizeof(SearchContext) + search_ctx_memory(s->reverse);
+    }
+    if (s->mark) {
+        bytes += 2 * s->mark_len + s->marked_cap * sizeof(int);
+    }
+    return bytes;
+}
+
+void search_ctx_destroy(SearchContext* s) {
+    free(s->comefrom);
+    free(s->open_set_map);
+    free(s->gen);
+    free(s->cell_g);
+    free(s->mark);
+    free(s->tmark);
+    free(s->marked);
+    free(s->ipath);
+    free(s->fpath);
+    arena_destroy(&s->arena);
+    dheap_destroy(&s->open_heap);
+    if (s->hpa_scratch) {
+        hpa_scratch_free(s->hpa_scratch);
+        free(s->hpa_scratch);
+    }
+    if (s->reverse) {
+        search_ctx_destroy(s->reverse);
+        free(s->reverse);
+    }
+}
+
+// 位图四周的边框都标记为阻挡
+static void set_border(char* bits, int width, int height) {
+    int x, y;
+    for (x = 0; x < width + 2; x++) {
+        BITSET(bits, x);
+        BITSET(bits, (height + 1) * (width + 2) + x);
+    }
+    for (y = 1; y <= height; y++) {
+        BITSET(bits, y * (width + 2));
+        BITSET(bits, y * (width + 2) + width + 1);
+    }
+}
+
+void map_init_scratch(Map* m, int width, int height) {
     int len = width * height;
     m->width = width;
     m->height = height;
-    m->start = -1;
-    m->end = -1;
     m->mark_connected = 0;
-    m->comefrom = (int*)malloc(len * sizeof(int));
-    m->ipath_cap = 2;
-    m->ipath_len = 0;
-    m->ipath = (int*)malloc(m->ipath_cap * sizeof(int));
-    m->visited = (char*)malloc(len * sizeof(char));
-    m->queue = (int *)malloc(len * sizeof(int));
-    m->connected = (int *)malloc(len * sizeof(int));
-    m->open_set_map =
-        (struct heap_node**)malloc(len * sizeof(struct heap_node*));
-    memset(m->m, 0, map_men_len * sizeof(m->m[0]));
+    m->visited = NULL; // 计算连通区域时才分配, 见 connected.c
+    m->queue = NULL;
+    m->uf_parent = NULL;
+    m->uf_cap = 0;
+    m->uf_free = 0;
+    m->uf_compact_at = 0;
+    search_ctx_init(&m->ctx, len);
+    m->pool = NULL;
+    int stride = width + 2;
+    int offset[8] = {-stride, 1 - stride, 1, 1 + stride, stride, stride - 1, -1, -1 - stride};
+    memcpy(m->bit_offset, offset, sizeof(offset));
+    m->m = NULL;
+    m->tm = NULL;
+    m->connected = NULL;
+    m->connected_wide = 0;
+    m->jump_table = NULL;
+    m->hpa = NULL;
+    m->graph = NULL;
+    m->tiles = NULL;
+    m->grid = NULL;
+}
+
+void init_map(Map* m, int width, int height) {
+    int map_men_len = BITMAP_LEN(width, height);
+    map_init_scratch(m, width, height);
+    m->connected = calloc(width * height, map_label_size(m)); // 未标记连通区域时全部视为连通
+    m->m = (char*)calloc(map_men_len, sizeof(char));
+    m->tm = (char*)calloc(map_men_len, sizeof(char));
+    set_border(m->m, width, height);
+    set_border(m->tm, height, width);
+    map_init_grid(m, NULL);
+}
+
+// 快照里的数据随映射一起释放
+static void free_owned(struct grid* g, void* p) {
+    if (!snapshot_contains(g->snapshot, p)) {
+        free(p);
+    }
+}
+
+static void grid_release(struct grid* g) {
+    if (__atomic_sub_fetch(&g->ref, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    free_owned(g, g->m);
+    free_owned(g, g->tm);
+    free_owned(g, g->connected);
+    if (g->jump_table) {
+        free_owned(g, g->jump_table);
+    }
+    if (g->snapshot) {
+        snapshot_release(g->snapshot);
+        free(g->snapshot);
+    }
+    free(g);
+}
+
+void map_init_grid(Map* m, struct snapshot* snap) {
+    struct grid* g = (struct grid*)malloc(sizeof(struct grid));
+    g->ref = 1;
+    g->width = m->width;
+    g->height = m->height;
+    g->m = m->m;
+    g->tm = m->tm;
+    g->connected = m->connected;
+    g->connected_wide = m->connected_wide;
+    g->jump_table = m->jump_table;
+    g->snapshot = snap;
+    m->grid = g;
+}
+
+static void* dup(const void* p, size_t size) {
+    void* q = malloc(size);
+    memcpy(q, p, size);
+    return q;
+}
+
+void map_unshare(Map* m) {
+    struct grid* g = m->grid;
+    if (__atomic_load_n(&g->ref, __ATOMIC_ACQUIRE) == 1) {
+        /*
+            共享期间关掉跳点表的一方成了唯一的持有者, 网格里留下的表没有人维护,
+            接下来原地修改阻挡后就过期了, 先丢掉, 免得再 share 出去
+        */
+        if (!m->jump_table && g->jump_table) {
+            free_owned(g, g->jump_table);
+            g->jump_table = NULL;
+        }
+        return;
+    }
+    int len = m->width * m->height;
+    int map_men_len = BITMAP_LEN(m->width, m->height);
+    struct grid* old = m->grid;
+    m->m = (char*)dup(m->m, map_men_len);
+    m->tm = (char*)dup(m->tm, map_men_len);
+    m->connected = dup(m->connected, len * map_label_size(m));
+    if (m->jump_table) {
+        m->jump_table = (signed char*)dup(m->jump_table, len * 8);
+    }
+    map_init_grid(m, NULL);
+    grid_release(old);
+}
+
+void map_set_connected_wide(Map* m, int wide) {
+    if (m->connected_wide == wide) {
+        return;
+    }
+    map_unshare(m);
+    int i, len = m->width * m->height;
+    void* p;
+    if (wide) {
+        const unsigned short* src = (const unsigned short*)m->connected;
+        int* dst = (int*)malloc(len * sizeof(int));
+        for (i = 0; i < len; i++) {
+            dst[i] = src[i];
+        }
+        p = dst;
+    } else {
+        const int* src = (const int*)m->connected;
+        unsigned short* dst = (unsigned short*)malloc(len * sizeof(unsigned short));
+        for (i = 0; i < len; i++) {
+            dst[i] = src[i];
+        }
+        p = dst;
+    }
+    free_owned(m->grid, m->connected);
+    m->connected = p;
+    m->connected_wide = wide;
+    m->grid->connected = p;
+    m->grid->connected_wide = wide;
+}
+
+// 还没被 attach 的 share, attach 前先在这里查找, 重复或无效的 share 不会被当成网格使用
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct grid_share* pending_shares = NULL;
+
+struct grid_share* map_share(Map* m) {
+    struct grid_share* share = (struct grid_share*)malloc(sizeof(struct grid_share));
+    __atomic_add_fetch(&m->grid->ref, 1, __ATOMIC_ACQ_REL);
+    share->grid = m->grid;
+    share->max_connected_id = m->mark_connected;
+    share->uf_parent = NULL;
+    share->uf_free = m->uf_free;
+    if (m->uf_parent) {
+        share->uf_parent = (int*)dup(m->uf_parent, (m->mark_connected + 1) * sizeof(int));
+    }
+    pthread_mutex_lock(&share_lock);
+    share->next = pending_shares;
+    pending_shares = share;
+    pthread_mutex_unlock(&share_lock);
+    return share;
+}
+
+int map_attach(Map* m, struct grid_share* share) {
+    struct grid_share** p;
+    int found = 0;
+    pthread_mutex_lock(&share_lock);
+    for (p = &pending_shares; *p; p = &(*p)->next) {
+        if (*p == share) {
+            *p = share->next;
+            found = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&share_lock);
+    if (!found) {
+        return 0;
+    }
+    struct grid* g = share->grid;
+    map_init_scratch(m, g->width, g->height);
+    m->grid = g;
+    m->m = g->m;
+    m->tm = g->tm;
+    m->connected = g->connected;
+    m->connected_wide = g->connected_wide;
+    m->jump_table = g->jump_table;
+    m->mark_connected = share->max_connected_id;
+    if (share->uf_parent) {
+        m->uf_parent = share->uf_parent;
+        m->uf_cap = share->max_connected_id + 1;
+        m->uf_free = share->uf_free;
+        m->uf_compact_at = connected_compact_at(m->mark_connected);
+    }
+    free(share);
+    return 1;
+}
+
+void map_destroy(Map* m) {
+    search_ctx_destroy(&m->ctx);
+    jps_plus_free(m);
+    hpa_free(m);
+    tiles_free(m);
+    free(m->uf_parent);
+    free(m->queue);
+    free(m->visited);
+    m->uf_parent = NULL;
+    m->queue = NULL;
+    m->visited = NULL;
+    if (m->grid) {
+        grid_release(m->grid);
+        m->grid = NULL;
+    }
+    m->m = m->tm = NULL;
+    m->connected = NULL;
+}
+
+// 阻挡状态没变时直接返回, 不复制共享的格子, 也不重算跳点表和分层图
+void map_set_block(Map* m, int pos) {
+    if (map_blocked(m, pos)) {
+        return;
+    }
+    map_unshare(m);
+    int x = pos % m->width, y = pos / m->width;
+    if (m->tiles) {
+        tiles_update(m, pos, 1);
+    }
+    BITSET(m->m, xy2bit(m, x, y));
+    BITSET(m->tm, (x + 1) * (m->height + 2) + y + 1);
+    if (m->jump_table) {
+        jps_plus_update(m, pos);
+    }
+    if (m->hpa) {
+        hpa_update(m, pos);
+    }
+}
+
+void map_clear_block(Map* m, int pos) {
+    if (!map_blocked(m, pos)) {
+        return;
+    }
+    map_unshare(m);
+    int x = pos % m->width, y = pos / m->width;
+    if (m->tiles) {
+        tiles_update(m, pos, 0);
+    }
+    BITCLEAR(m->m, xy2bit(m, x, y));
+    BITCLEAR(m->tm, (x + 1) * (m->height + 2) + y + 1);
+    if (m->jump_table) {
+        jps_plus_update(m, pos);
+    }
+    if (m->hpa) {
+        hpa_update(m, pos);
+    }
+}
+
+void map_clear_allblock(Map* m) {
+    map_unshare(m);
+    int len = BITMAP_LEN(m->width, m->height);
+    memset(m->m, 0, len * sizeof(m->m[0]));
+    memset(m->tm, 0, len * sizeof(m->tm[0]));
+    set_border(m->m, m->width, m->height);
+    set_border(m->tm, m->height, m->width);
+    if (m->jump_table) {
+        jps_plus_build(m);
+    }
+    if (m->hpa) {
+        hpa_invalidate_all(m);
+    }
+    if (m->tiles) {
+        tiles_build(m);
+    }
 }
 
 int dist(int one, int two, int w) {
@@ -51,5 +419,5 @@ int dist(int one, int two, int w) {
 }
 
 inline int map_walkable(Map* m, int pos) {
-    return check_in_map_pos(pos, m->width * m->height) && !BITTEST(m->m, pos);
+    return check_in_map_pos(pos, m->width * m->height) && !map_blocked(m, pos);
 }
\ No newline at end of file
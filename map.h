@@ -2,11 +2,14 @@
 #define __MAP__ 0
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "lauxlib.h"
 #include "lua.h"
 #include "lualib.h"
+#include "arena.h"
+#include "dheap.h"
 
 #define BITMASK(b) (1 << ((b) % CHAR_BIT))
 #define BITSLOT(b) ((b) / CHAR_BIT)
@@ -14,27 +17,130 @@
 #define BITCLEAR(a, b) ((a)[BITSLOT(b)] &= ~BITMASK(b))
 #define BITTEST(a, b) ((a)[BITSLOT(b)] & BITMASK(b))
 
-typedef struct map {
-    int width;
-    int height;
+#define OPEN_LIST_FIBHEAP 0
+#define OPEN_LIST_DHEAP 1
+
+#define SEARCH_JPS 0
+#define SEARCH_THETA 1 // Lazy Theta* 任意角度寻路, 见 theta.h
+#define SEARCH_BIDIR 2 // 双向跳点寻路, 见 jps.h
+
+// 寻路函数找到路径时返回终点, 否则返回下面的值
+#define SEARCH_NONE (-1) // 没有路径
+#define SEARCH_PENDING (-2) // 还没搜完, 可以继续分步搜索
+
+/*
+    一次寻路用到的全部临时状态, 与只读的地图数据分开,
+    每个线程各持有一份就可以在同一张地图上并发寻路
+*/
+typedef struct search_ctx {
     int start;
     int end;
+    int len; // 地图格子数, 下面几个按格子的数组第一次寻路时才分配
     int* comefrom;
-    char mark_connected;
-    int* connected;
-    int *queue;
-    char *visited;
-
-    struct heap_node** open_set_map;
+    struct heap_node** open_set_map; // 4叉堆模式下当作 int 槽位索引使用
     /*
-        [map] | [close_set] | [path]
+        每个格子的寻路代数, 等于 search_gen 表示本次寻路已访问(comefrom/open_set_map 有效),
+        等于 search_gen + 1 表示已在 close_set 中, 其它值都视为未访问
     */
-    
+    unsigned int* gen;
+    unsigned int search_gen;
+    struct arena arena; // 寻路节点内存池, 每次寻路开始时重置
+    char open_list; // OPEN_LIST_FIBHEAP / OPEN_LIST_DHEAP
+    struct dheap open_heap;
+    int expanded; // 上次寻路从 open_set 取出的节点数
+    char search; // SEARCH_JPS / SEARCH_THETA / SEARCH_BIDIR
+    int* cell_g; // 任意角度寻路和双向寻路时每格的 g 值, 第一次用到时才分配
+    struct heap* open_set; // 斐波那契堆模式下本次寻路的堆, 分步寻路时跨调用保留
+    int max_expanded; // 一次寻路最多展开的节点数, 0 表示不限
+    int closest; // 已展开节点中到终点估价最小的, 没搜完时从它回溯出部分路径
+    int closest_h;
+    char partial; // 上次 search_ipath 得到的是到 closest 的部分路径
+
+    struct search_ctx* reverse; // 双向寻路时从终点出发的反向搜索, 用到时才分配
+    struct search_ctx* other; // 双向寻路进行中时指向另一侧的上下文, 否则为 NULL
+    int meet; // 本侧发现的最短相遇路径途经的另一侧访问过的格子, 没有时为 -1
+    int meet_from; // 本侧到达 meet 的节点, 两者之间是一段直线或斜线加直线
+    int meet_g; // 相遇路径的长度
+    char* mark; // 双向寻路时本侧访问过的格子, 与阻挡位图布局相同, 供另一侧扫描时发现相遇点
+    char* tmark; // 转置的 mark
+    int mark_len; // mark 和 tmark 各自的字节数
+    int* marked; // mark 中置位的格子, 下次寻路前逐个清除
+    int nmarked;
+    int marked_cap;
+
     int* ipath; // 整型路点，锚点为格子中心
     int ipath_len;
     int ipath_cap;
-    
-    char m[0];
+    float* fpath; // 浮点路点, x, y 交替存放, 多次寻路复用
+    int fpath_len; // 路点数
+    int fpath_cap;
+    struct hpa_scratch* hpa_scratch; // 分层寻路的临时缓冲, 用到时才分配
+} SearchContext;
+
+struct path_pool;
+struct hpa;
+struct graph;
+struct tiles;
+struct snapshot;
+
+/*
+    网格数据(阻挡位图、连通区域 id、跳点表)的所有者, 可以被多个 lua_State 里的 Map 共享,
+    引用计数归零时释放. Map 里的 m / tm / connected / jump_table 指向这里的数据,
+    修改之前先调用 map_unshare, 共享中的网格会先复制出私有的一份
+*/
+struct grid {
+    int ref;
+    int width;
+    int height;
+    char* m;
+    char* tm;
+    void* connected;
+    char connected_wide;
+    signed char* jump_table;
+    struct snapshot* snapshot; // 从快照加载时数据在映射的文件里, 否则为 NULL
+};
+
+// 把网格交给另一个 lua_State 时带上当时的连通区域并查集
+struct grid_share {
+    struct grid* grid;
+    int max_connected_id;
+    int* uf_parent;
+    int uf_free;
+    struct grid_share* next; // 还没被 attach 的 share 链表
+};
+
+typedef struct map {
+    int width;
+    int height;
+    int mark_connected; // 已分配的最大区域标号, 0 表示还没标记
+    /*
+        每格的区域标号, 经 uf_parent 找到根才是区域 id.
+        标号不超过 CONNECTED_NARROW_MAX 时每格 2 字节, 否则 connected_wide 为 1, 每格 4 字节
+    */
+    void* connected;
+    char connected_wide;
+    int* uf_parent; // 区域标号的并查集, 见 connected.h
+    int uf_cap;
+    int uf_free; // 可以重用的标号链表头, 0 表示没有, 链表存在 uf_parent 里
+    int uf_compact_at; // 标号用到这里时回收一次不再使用的标号
+    int *queue; // queue 和 visited 在计算连通区域时才分配
+    char *visited;
+
+    SearchContext ctx; // 主线程寻路用的上下文
+    struct path_pool* pool; // 批量寻路线程池, 未开启时为 NULL
+
+    int bit_offset[8]; // 各方向相邻格在带边框位图中的下标偏移
+    char* tm; // 转置(按列存储)的阻挡位图, 用于纵向跳点扫描
+    signed char* jump_table; // JPS+ 跳点距离表, 每格8个方向, 未开启时为 NULL
+    struct hpa* hpa; // 分层寻路的抽象图, 未开启时为 NULL
+    struct graph* graph; // 传送点连接点构成的区域图, 第一次加节点时创建
+    struct tiles* tiles; // 分块的阻挡统计, 见 tile.h, 未开启时为 NULL
+    struct grid* grid; // 下面几个数组的所有者, 可能与其它 Map 共享
+
+    /*
+        阻挡位图, 四周多一圈阻挡格作为边框, 每行 width + 2 位
+    */
+    char* m;
 
 } Map;
 
@@ -78,8 +184,78 @@ inline int xy2pos(Map* m, int x, int y) {
     return m->width * y + x;
 }
 
-void push_pos_to_ipath(Map* m, int pos);
-void init_map(Map* m, int width, int height, int map_men_len);
+inline int xy2bit(Map* m, int x, int y) {
+    return (m->width + 2) * (y + 1) + x + 1;
+}
+
+inline int pos2bit(Map* m, int pos) {
+    return pos + m->width + 3 + 2 * (pos / m->width);
+}
+
+inline int map_blocked(Map* m, int pos) {
+    return BITTEST(m->m, pos2bit(m, pos));
+}
+
+#define CONNECTED_NARROW_MAX 65535
+
+static inline int map_label(Map* m, int pos) {
+    return m->connected_wide ? ((int*)m->connected)[pos] : ((unsigned short*)m->connected)[pos];
+}
+
+// id 要在当前的存储宽度内, 见 connected.c 中的 uf_reserve
+static inline void map_set_label(Map* m, int pos, int id) {
+    if (m->connected_wide) {
+        ((int*)m->connected)[pos] = id;
+    } else {
+        ((unsigned short*)m->connected)[pos] = id;
+    }
+}
+
+static inline size_t map_label_size(Map* m) {
+    return m->connected_wide ? sizeof(int) : sizeof(unsigned short);
+}
+
+// 位图末尾多留的字节, 保证按64位读取时不越界
+#define BITMAP_PADDING 8
+#define BITMAP_LEN(w, h) (BITSLOT(((w) + 2) * ((h) + 2)) + 1 + BITMAP_PADDING)
+
+// 从位图第 pos 位开始读取一个字, 只保证低 57 位有效
+static inline uint64_t bitmap_load(const char* bits, int pos) {
+    uint64_t v;
+    memcpy(&v, bits + BITSLOT(pos), sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v >> (pos % CHAR_BIT);
+}
+
+void search_ctx_init(SearchContext* s, int len);
+// 寻路开始前调用, 按格子的数组还没分配时分配
+void search_ctx_prepare(SearchContext* s);
+// 按格子的 g 值数组, 没分配时分配
+void search_ctx_prepare_cell_g(SearchContext* s);
+void search_ctx_destroy(SearchContext* s);
+// 寻路缓冲占用的字节数
+size_t search_ctx_memory(const SearchContext* s);
+void push_pos_to_ipath(SearchContext* s, int pos);
+// 只分配寻路和连通区域计算用的缓冲, 位图等由调用方设置
+void map_init_scratch(Map* m, int width, int height);
+void init_map(Map* m, int width, int height);
+// 释放地图持有的所有内存, 不包括线程池和区域图
+void map_destroy(Map* m);
+// 让 m->grid 接管 m 当前的 m / tm / connected / jump_table
+void map_init_grid(Map* m, struct snapshot* snap);
+// 修改网格数据之前调用, 网格被共享时复制一份私有的
+void map_unshare(Map* m);
+// 切换 connected 的存储宽度, 已有的标号原样复制(收窄时由调用方保证不截断或随后覆盖)
+void map_set_connected_wide(Map* m, int wide);
+// 增加一个引用交给别的 lua_State, 对方用 map_attach 接收, 每个 share 只能 attach 一次
+struct grid_share* map_share(Map* m);
+// share 已经 attach 过或者不是 map_share 的结果时返回 0, m 保持未初始化
+int map_attach(Map* m, struct grid_share* share);
+void map_set_block(Map* m, int pos);
+void map_clear_block(Map* m, int pos);
+void map_clear_allblock(Map* m);
 int dist(int one, int two, int w);
 int map_walkable(Map* m, int pos);
 #endif /* __MAP__ */
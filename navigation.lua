@@ -3,6 +3,8 @@ local navigation_c = require "navigation.c"
 local mfloor = math.floor
 local sqrt = math.sqrt
 
+local path_buf = {} -- find_path_into 的复用缓冲区
+
 ---@class LuaNavigationPosition
 ---@field x number
 ---@field y number
@@ -10,12 +12,13 @@ local sqrt = math.sqrt
 ---@class LuaNavigationNode
 ---@field cell number
 ---@field pos LuaNavigationPosition
----@field g number
----@field h number
----@field f number
----@field prev LuaNavigationNode
----@field connected table<LuaNavigationNode, {LuaNavigationPosition[], number}>
----@field disabled boolean 是否不可用
+---@field id number C 层图中的节点 id
+---@field area_id number 加入时所在的区域
+---@field connected table<LuaNavigationNode, LuaNavigationSegment>
+
+---@class LuaNavigationSegment 连接点之间的路径缓存
+---@field [1] LuaNavigationPosition[]|false|nil 平滑后的路径, nil 表示还没算, false 表示走不通
+---@field [2] number 路径长度, 没算之前是直线距离
 
 ---@class LuaNavigation
 local mt = {}
@@ -34,18 +37,16 @@ local function cell2pos(self, cell)
     }
 end
 
-local function create_node(cell, pos)
+-- 连接点之间的寻路在 C 层的图上做, lua 层只缓存节点之间的路径
+local function create_node(self, cell, pos, area_id)
     ---@class LuaNavigationNode
     local node = {
         cell = cell,
         pos = pos,
-        g = 0,
-        h = 0,
-        f = 0,
-        prev = nil,
+        id = self.core:graph_add_node(pos.x, pos.y, area_id),
         connected = {}, -- {node -> {path, length}}
-        disabled = false
     }
+    self.graph.by_id[node.id] = node
     return node
 end
 
@@ -53,8 +54,7 @@ local function create_graph()
     ---@class LuaNavigationGraph
     local graph = {
         nodes = {}, ---@type {[number]: LuaNavigationNode}
-        open_set = {},
-        closed_set = {},
+        by_id = {}, ---@type {[number]: LuaNavigationNode}
     }
     return graph
 end
@@ -103,10 +103,68 @@ end
 ---@param node1 LuaNavigationNode
 ---@param node2 LuaNavigationNode
 local function connect_nodes(self, node1, node2)
+    -- 同区域的连接点之间先按直线距离连上, 路径在寻路用到时才算
+    local distance = calc_distance(node1.pos, node2.pos)
+    node1.connected[node2] = { nil, distance }
+    node2.connected[node1] = { nil, distance }
+    self.core:graph_connect(node1.id, node2.id, distance)
+end
+
+---@param self LuaNavigation
+---@param node1 LuaNavigationNode
+---@param node2 LuaNavigationNode
+local function resolve_segment(self, node1, node2)
     local path = self:find_path(node1.pos, node2.pos)
+    if #path < 2 then
+        node1.connected[node2] = { false, math.huge }
+        node2.connected[node1] = { false, math.huge }
+        self.core:graph_disconnect(node1.id, node2.id)
+        return
+    end
     local length = calc_path_length(path)
+    local tainted = self.tainted_segments
+    if tainted then
+        tainted[#tainted + 1] = node1
+        tainted[#tainted + 1] = node2
+    end
     node1.connected[node2] = { path, length }
     node2.connected[node1] = { reverse_path(path), length }
+    self.core:graph_connect(node1.id, node2.id, length)
+end
+
+-- 区域内阻挡变化后, 缓存的路径全部作废, 边权退回直线距离
+---@param self LuaNavigation
+---@param area LuaNavigationArea
+local function invalidate_area_segments(self, area)
+    for _, node1 in pairs(area.joints) do
+        for node2, seg in pairs(node1.connected) do
+            if seg[1] ~= nil and node2 ~= node1 and area.joints[node2.cell] == node2 then
+                connect_nodes(self, node1, node2)
+            end
+        end
+    end
+end
+
+---@param self LuaNavigation
+---@param x number
+---@param y number
+local function invalidate_segments_around(self, x, y)
+    if not next(self.graph.nodes) then
+        return
+    end
+    local core = self.core
+    local touched = {}
+    -- 加阻挡看格子本身所在区域, 去阻挡可能影响四周的区域
+    for _, d in ipairs { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } } do
+        local nx, ny = x + d[1], y + d[2]
+        if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h then
+            local area = self.areas[core:get_connected_id(nx, ny)]
+            if area and not touched[area] then
+                touched[area] = true
+                invalidate_area_segments(self, area)
+            end
+        end
+    end
 end
 
 
@@ -116,14 +174,17 @@ end
 local function disconnect_nodes(self, node1, node2)
     node1.connected[node2] = nil
     node2.connected[node1] = nil
+    self.core:graph_disconnect(node1.id, node2.id)
 end
 
+---@param self LuaNavigation
 ---@param node1 LuaNavigationNode
 ---@param node2 LuaNavigationNode
-local function connect_nodes_cross_area(node1, node2)
+local function connect_nodes_cross_area(self, node1, node2)
     local distance = calc_distance(node1.pos, node2.pos)
     node1.connected[node2] = { { node1.pos, node2.pos }, distance }
     node2.connected[node1] = { { node2.pos, node1.pos }, distance }
+    self.core:graph_connect(node1.id, node2.id, distance)
 end
 
 ---@param self LuaNavigation
@@ -141,9 +202,12 @@ local function area_add_joint(self, area, pos)
     local nodes = self.graph.nodes
     local node = nodes[cell]
     if not node then
-        node = create_node(cell, pos)
+        node = create_node(self, cell, pos, area.area_id)
         nodes[cell] = node
+    else
+        self.core:graph_set_area(node.id, area.area_id)
     end
+    node.area_id = area.area_id
     area.joints[cell] = node
     for from in pairs(area.joints) do
         for to in pairs(area.joints) do
@@ -159,20 +223,27 @@ local function area_add_joint(self, area, pos)
     return node
 end
 
+-- 连接点从它加入时的区域删除, 区域 id 之后可能已经被重新标记过
 ---@param self LuaNavigation
----@param area LuaNavigationArea
 ---@param pos LuaNavigationPosition
-local function area_del_joint(self, area, pos)
+local function area_del_joint(self, pos)
     local cell = pos2cell(self, pos)
     local nodes = self.graph.nodes
     local node = nodes[cell]
-    if node then
-        for from in pairs(node.connected) do
-            from.connected[node] = nil
-        end
+    if not node then
+        return
+    end
+    for from in pairs(node.connected) do
+        from.connected[node] = nil
+    end
+    -- 清理节点, C 层会一并删掉相连的边
+    self.core:graph_del_node(node.id)
+    self.graph.by_id[node.id] = nil
+    nodes[cell] = nil
+    local area = self.areas[node.area_id]
+    if area and area.joints[cell] == node then
+        area.joints[cell] = nil
     end
-    -- 清理节点
-    self.graph.nodes[cell] = nil
 end
 
 function mt:init(w, h, obstacles)
@@ -192,30 +263,31 @@ end
 
 function mt:update_areas()
     self.core:mark_connected()
+    for _, area in pairs(self.areas) do
+        invalidate_area_segments(self, area)
+    end
 end
 
 function mt:set_obstacle(pos)
-    local cell = pos2cell(self, pos)
     -- 检查是否有连接点
-    for _, area in pairs(self.areas) do
-        local node = area.joints[cell]
-        if node then
-            node.disabled = true
-        end
+    local node = self.graph.nodes[pos2cell(self, pos)]
+    if node then
+        self.core:graph_set_disabled(node.id, true)
     end
-    self.core:add_block(mfloor(pos.x), mfloor(pos.y))
+    local x, y = mfloor(pos.x), mfloor(pos.y)
+    invalidate_segments_around(self, x, y)
+    self.core:add_block(x, y)
 end
 
 function mt:unset_obstacle(pos)
-    local cell = pos2cell(self, pos)
     -- 检查是否有连接点
-    for _, area in pairs(self.areas) do
-        local node = area.joints[cell]
-        if node then
-            node.disabled = false
-        end
+    local node = self.graph.nodes[pos2cell(self, pos)]
+    if node then
+        self.core:graph_set_disabled(node.id, false)
     end
-    self.core:clear_block(mfloor(pos.x), mfloor(pos.y))
+    local x, y = mfloor(pos.x), mfloor(pos.y)
+    self.core:clear_block(x, y)
+    invalidate_segments_around(self, x, y)
 end
 
 function mt:is_obstacle(pos)
@@ -230,53 +302,44 @@ function mt:get_max_connected_id()
     return self.core:get_max_connected_id()
 end
 
+-- 格子阻挡状态改变后增量更新区域 id, 连接点区域变了的传送点重新添加
 function mt:quick_remark_area(change_pos)
     local x = mfloor(change_pos.x)
     local y = mfloor(change_pos.y)
+    local changed
+    if self.core:is_block(x, y) then
+        changed = self.core:add_block_and_remark(x, y)
+    else
+        changed = self.core:clear_block_and_remark(x, y)
+    end
+    if #changed == 0 then
+        return
+    end
+    local changed_set = {}
+    for _, area_id in ipairs(changed) do
+        changed_set[area_id] = true
+    end
 
     -- 记录所有受影响的传送点
     local affected_portals = {} -- {[portal_cell] = portal}
-
-    -- 检查格子是否是传送点的连接点，如果是则记录其传送点
-    local function check_portal_joint(px, py)
-        local pos = {x = px + 0.5, y = py + 0.5}
-        for portal_cell, portal in pairs(self.portals) do
-            for _, joint in pairs(portal.joints) do
-                if mfloor(joint.x) == px and mfloor(joint.y) == py then
-                    affected_portals[portal_cell] = portal
-                    break
-                end
+    local nodes = self.graph.nodes
+    for portal_cell, portal in pairs(self.portals) do
+        for _, joint in pairs(portal.joints) do
+            local node = nodes[pos2cell(self, joint)]
+            local area_id = self:get_area_id_by_pos(joint)
+            if changed_set[area_id] and (not node or node.area_id ~= area_id) then
+                affected_portals[portal_cell] = portal
+                break
             end
         end
     end
 
-    -- 设置区域id并检查变化
-    local function set_area_id(px, py, new_id)
-        local old_id = self.core:get_connected_id(px, py)
-        if old_id ~= new_id then
-            check_portal_joint(px, py)
-        end
-        self.core:set_connected_id(px, py, new_id)
-    end
-
-    local is_block = self.core:is_block(x, y)
-
-    if is_block then
-        -- 处理添加阻挡点的情况：找新产生的空洞
-        self:_handle_add_block(x, y, set_area_id)
-    else
-        -- 处理移除阻挡点的情况：合并原来分离的区域
-        self:_handle_remove_block(x, y, set_area_id)
-    end
-
     -- 删除受影响的传送点
     local portals_to_readd = {}
     for portal_cell, portal in pairs(affected_portals) do
         portals_to_readd[#portals_to_readd + 1] = {
             pos = cell2pos(self, portal_cell),
             camp = portal.camp,
-            radius = 10, -- 默认半径
-            joints = portal.joints
         }
         self:del_portal(cell2pos(self, portal_cell))
     end
@@ -287,297 +350,6 @@ function mt:quick_remark_area(change_pos)
     end
 end
 
--- 修改_handle_add_block函数，添加set_area_id参数
-function mt:_handle_add_block(x, y, set_area_id)
-    -- 1. 先临时移除当前点的阻挡，获取原始连通状态
-    self.core:clear_block(x, y)
-
-    local directions = {
-        { -1, 0 }, -- 左
-        { 1, 0 },  -- 右
-        { 0, -1 }, -- 上
-        { 0, 1 }   -- 下
-    }
-
-    local neighbor_points = {}
-
-    -- 收集周围不同的连通区域ID和对应的点（在移除阻挡点的状态下）
-    for _, dir in ipairs(directions) do
-        local nx, ny = x + dir[1], y + dir[2]
-        if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-            not self.core:is_block(nx, ny) then
-            local area_id = self.core:get_connected_id(nx, ny)
-            if area_id > 0 then
-                neighbor_points[#neighbor_points + 1] = { nx, ny, area_id }
-            end
-        end
-    end
-
-    -- 2. 重新添加阻挡点
-    self.core:add_block(x, y)
-
-    -- 3. 如果没有邻近点，直接返回
-    if #neighbor_points == 0 then
-        return
-    end
-
-    local function pos_key(px, py)
-        return px + py * self.w
-    end
-
-    -- 4. 按area_id分组
-    local area_groups = {}
-    for _, point in ipairs(neighbor_points) do
-        local area_id = point[3]
-        if not area_groups[area_id] then
-            area_groups[area_id] = {}
-        end
-        area_groups[area_id][#area_groups[area_id] + 1] = { point[1], point[2] }
-    end
-
-    local processed = {}
-    local new_connected_id = self.core:get_max_connected_id() + 1
-
-    -- 5. 对于每个有多个邻近点的area_id，检查是否被分割
-    for area_id, points in pairs(area_groups) do
-        if #points > 1 then
-            -- 从第一个点开始BFS，看能连通到多少个同area_id的邻近点
-            local first_point = points[1]
-            local visited = {}
-            local queue = {}
-            local reachable_neighbors = {}
-
-            queue[#queue + 1] = first_point
-            visited[pos_key(first_point[1], first_point[2])] = true
-
-            local head = 1
-            while head <= #queue do
-                local cur = queue[head]
-                head = head + 1
-                local cx, cy = cur[1], cur[2]
-
-                -- 检查这个点是否是邻近点之一
-                for _, neighbor in ipairs(points) do
-                    if neighbor[1] == cx and neighbor[2] == cy then
-                        reachable_neighbors[#reachable_neighbors + 1] = neighbor
-                        break
-                    end
-                end
-
-                -- 检查四个方向的相邻点
-                for _, dir in ipairs(directions) do
-                    local nx, ny = cx + dir[1], cy + dir[2]
-                    local key = pos_key(nx, ny)
-
-                    if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-                        not visited[key] and not self.core:is_block(nx, ny) then
-                        local point_area_id = self.core:get_connected_id(nx, ny)
-                        if point_area_id == area_id then
-                            visited[key] = true
-                            queue[#queue + 1] = { nx, ny }
-                        end
-                    end
-                end
-            end
-
-            -- 6. 如果无法连通到所有邻近点，说明区域被分割了
-            if #reachable_neighbors < #points then
-                -- 标记第一个连通组件为已处理
-                for _, point in ipairs(reachable_neighbors) do
-                    processed[pos_key(point[1], point[2])] = true
-                end
-
-                -- 为其他不连通的邻近点分配新的区域ID
-                for _, start_point in ipairs(points) do
-                    local key = pos_key(start_point[1], start_point[2])
-                    if not processed[key] then
-                        -- 从这个点开始BFS，找出它的完整连通区域
-                        local new_visited = {}
-                        local new_queue = {}
-
-                        new_queue[#new_queue + 1] = start_point
-                        new_visited[key] = true
-
-                        local new_head = 1
-                        while new_head <= #new_queue do
-                            local cur = new_queue[new_head]
-                            new_head = new_head + 1
-                            local cx, cy = cur[1], cur[2]
-
-                            -- 设置新的区域ID
-                            if set_area_id then
-                                set_area_id(cx, cy, new_connected_id)
-                            else
-                                self.core:set_connected_id(cx, cy, new_connected_id)
-                            end
-
-                            -- 检查四个方向的相邻点
-                            for _, dir in ipairs(directions) do
-                                local nx, ny = cx + dir[1], cy + dir[2]
-                                local nkey = pos_key(nx, ny)
-
-                                if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-                                    not new_visited[nkey] and not self.core:is_block(nx, ny) then
-                                    local point_area_id = self.core:get_connected_id(nx, ny)
-                                    if point_area_id == area_id then
-                                        new_visited[nkey] = true
-                                        new_queue[#new_queue + 1] = { nx, ny }
-                                    end
-                                end
-                            end
-                        end
-
-                        processed[key] = true
-                        new_connected_id = new_connected_id + 1
-                    end
-                end
-            else
-                -- 所有邻近点都还能连通，标记为已处理
-                for _, point in ipairs(points) do
-                    processed[pos_key(point[1], point[2])] = true
-                end
-            end
-        end
-    end
-end
-
--- 修改_handle_remove_block函数，添加set_area_id参数
-function mt:_handle_remove_block(x, y, set_area_id)
-    -- 1. 检查当前点周围的连通区域
-    local directions = {
-        { -1, 0 }, -- 左
-        { 1, 0 },  -- 右
-        { 0, -1 }, -- 上
-        { 0, 1 }   -- 下
-    }
-
-    local neighbor_areas = {}
-    local area_count = {}
-
-    -- 收集周围不同的连通区域ID
-    for _, dir in ipairs(directions) do
-        local nx, ny = x + dir[1], y + dir[2]
-        if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-            not self.core:is_block(nx, ny) then
-            local area_id = self.core:get_connected_id(nx, ny)
-            if area_id > 0 then
-                if not neighbor_areas[area_id] then
-                    neighbor_areas[area_id] = {}
-                    area_count[area_id] = 0
-                end
-                neighbor_areas[area_id][#neighbor_areas[area_id] + 1] = { nx, ny }
-                area_count[area_id] = area_count[area_id] + 1
-            end
-        end
-    end
-
-    -- 2. 如果周围有多个不同的连通区域，需要合并它们
-    local area_ids = {}
-    for area_id in pairs(neighbor_areas) do
-        area_ids[#area_ids + 1] = area_id
-    end
-
-    if #area_ids > 1 then
-        -- 选择最小的area_id作为目标ID
-        table.sort(area_ids)
-        local target_area_id = area_ids[1]
-
-        -- 3. 从当前点开始，找出所有能连通到的区域
-        local visited = {}
-        local queue = {}
-        local merged_points = {}
-
-        local function pos_key(px, py)
-            return px + py * self.w
-        end
-
-        -- 将当前点加入队列作为起点
-        queue[#queue + 1] = { x, y }
-        visited[pos_key(x, y)] = true
-        merged_points[#merged_points + 1] = { x, y }
-
-        -- BFS遍历所有能连通的点
-        local head = 1
-        while head <= #queue do
-            local cur = queue[head]
-            head = head + 1
-            local cx, cy = cur[1], cur[2]
-
-            -- 检查四个方向的相邻点
-            for _, dir in ipairs(directions) do
-                local nx, ny = cx + dir[1], cy + dir[2]
-                local key = pos_key(nx, ny)
-
-                if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-                    not visited[key] and not self.core:is_block(nx, ny) then
-                    local area_id = self.core:get_connected_id(nx, ny)
-
-                    -- 如果是需要合并的区域之一
-                    if neighbor_areas[area_id] then
-                        visited[key] = true
-                        queue[#queue + 1] = { nx, ny }
-                        merged_points[#merged_points + 1] = { nx, ny }
-                    end
-                end
-            end
-        end
-
-        -- 4. 将所有合并的点设置为目标区域ID
-        for _, point in ipairs(merged_points) do
-            if set_area_id then
-                set_area_id(point[1], point[2], target_area_id)
-            else
-                self.core:set_connected_id(point[1], point[2], target_area_id)
-            end
-        end
-
-        -- 5. 使用BFS找出与合并点连通的所有区域，统一设置ID
-        local final_visited = {}
-        local final_queue = {}
-
-        -- 将所有合并点作为种子加入队列
-        for _, point in ipairs(merged_points) do
-            local key = pos_key(point[1], point[2])
-            if not final_visited[key] then
-                final_visited[key] = true
-                final_queue[#final_queue + 1] = point
-            end
-        end
-
-        local final_head = 1
-        while final_head <= #final_queue do
-            local cur = final_queue[final_head]
-            final_head = final_head + 1
-            local cx, cy = cur[1], cur[2]
-
-            -- 检查四个方向的相邻点
-            for _, dir in ipairs(directions) do
-                local nx, ny = cx + dir[1], cy + dir[2]
-                local key = pos_key(nx, ny)
-
-                if nx >= 0 and nx < self.w and ny >= 0 and ny < self.h and
-                    not final_visited[key] and not self.core:is_block(nx, ny) then
-                    final_visited[key] = true
-                    final_queue[#final_queue + 1] = { nx, ny }
-                    if set_area_id then
-                        set_area_id(nx, ny, target_area_id)
-                    else
-                        self.core:set_connected_id(nx, ny, target_area_id)
-                    end
-                end
-            end
-        end
-    else
-        -- 如果只有一个或没有邻近区域，直接设置当前点的区域ID
-        local target_area_id = area_ids[1] or (self.core:get_max_connected_id() + 1)
-        if set_area_id then
-            set_area_id(x, y, target_area_id)
-        else
-            self.core:set_connected_id(x, y, target_area_id)
-        end
-    end
-end
-
 function mt:get_area_id_by_pos(pos)
     return self.core:get_connected_id(mfloor(pos.x), mfloor(pos.y))
 end
@@ -666,7 +438,7 @@ function mt:add_portal(center_pos, camp, max_size, joints)
         local area = self:get_area(area_id)
         local node = area_add_joint(self, area, pos)
         if last_node then
-            connect_nodes_cross_area(node, last_node)
+            connect_nodes_cross_area(self, node, last_node)
         else
             last_node = node
         end
@@ -678,9 +450,7 @@ function mt:del_portal(pos)
     local portal = self.portals[cell]
     if portal then
         for _, joint in pairs(portal.joints) do
-            local area_id = self:get_area_id_by_pos(joint)
-            local area = self:get_area(area_id)
-            area_del_joint(self, area, joint)
+            area_del_joint(self, joint)
         end
         self.portals[cell] = nil
     else
@@ -688,23 +458,6 @@ function mt:del_portal(pos)
     end
 end
 
-local function connect_to_area(area, node)
-    for _, joint in pairs(area.joints) do
-        if not joint.disabled then
-            local distance = calc_distance(node.pos, joint.pos)
-            node.connected[joint] = { { node.pos, joint.pos }, distance }
-            joint.connected[node] = { { joint.pos, node.pos }, distance }
-        end
-    end
-end
-
-local function disconnect_to_area(area, node)
-    for _, joint in pairs(area.joints) do
-        node.connected[joint] = nil
-        joint.connected[node] = nil
-    end
-end
-
 local function merge_path(path1, path2)
     for i = 1, #path2 - 1 do
         path1[#path1 + 1] = { x = path2[i].x, y = path2[i].y }
@@ -739,94 +492,39 @@ end
 
 ---@param self LuaNavigation
 local function find_path_cross_area(self, src_area_id, src_pos, dst_area_id, dst_pos)
-    local graph = self.graph
-    local open_set = {}
-    local closed_set = {}
-
-    local src_cell = pos2cell(self, src_pos)
-    local dst_cell = pos2cell(self, dst_pos)
-    local src_node = create_node(src_cell, src_pos)
-    local dst_node = create_node(dst_cell, dst_pos)
-    local src_area = self:get_area(src_area_id)
-    local dst_area = self:get_area(dst_area_id)
-
-    connect_to_area(src_area, src_node)
-    connect_to_area(dst_area, dst_node)
-
     local path = {}
-
-    local ok, errmsg = xpcall(function()
-        local function add_to_open_set(node, prev)
-            if open_set[node] or closed_set[node] then
-                return
-            end
-            open_set[node] = true
-            node.prev = prev
-            if prev then
-                node.g = prev.g + calc_distance(node.pos, prev.pos)
-            else
-                node.g = 0
-            end
-            node.h = calc_distance(node.pos, dst_pos)
-            node.f = node.g + node.h
+    local by_id = self.graph.by_id
+    local ids
+    -- 没算过的边权是直线距离, 不会比真实路径长. 结果里用到的边都算出真实路径后才是最短路
+    while true do
+        ids = self.core:graph_find_path(src_pos.x, src_pos.y, src_area_id, dst_pos.x, dst_pos.y, dst_area_id)
+        if not ids or #ids == 0 then
+            return path
         end
-        add_to_open_set(src_node)
-        while next(open_set) do
-            local cur_node
-            for node in pairs(open_set) do
-                if not cur_node then
-                    cur_node = node
-                else
-                    if node.f < cur_node.f then
-                        cur_node = node
-                    end
-                end
+        local resolved = true
+        for i = 1, #ids - 1 do
+            local cur_node = by_id[ids[i]]
+            local next_node = by_id[ids[i + 1]]
+            if cur_node.connected[next_node][1] == nil then
+                resolve_segment(self, cur_node, next_node)
+                resolved = false
             end
-            open_set[cur_node] = nil
-            closed_set[cur_node] = true
-            for node in pairs(cur_node.connected) do
-                if not node.disabled and not closed_set[node] and not open_set[node] then
-                    add_to_open_set(node, cur_node)
-                end
-            end
-        end
-
-        if not dst_node.prev then
-            return {}
         end
-        local node_path = {} ---@type LuaNavigationNode[]
-        local node = dst_node
-        while true do
-            node_path[#node_path + 1] = node
-            if node == src_node then
-                break
-            end
-            node = node.prev
+        if resolved then
+            break
         end
-
-        node_path = reverse_path(node_path)
-        local first = node_path[1]
-        local second = node_path[2]
-        first.connected[second][1] = self:find_path(first.pos, second.pos)
-        local last = node_path[#node_path]
-        local last_second = node_path[#node_path - 1]
-        last_second.connected[last][1] = self:find_path(last_second.pos, last.pos)
-
-        for i = 1, #node_path - 1 do
-            local cur_node = node_path[i]
-            local next_node = node_path[i + 1]
-            local part = cur_node.connected[next_node][1]
-            merge_path(path, part)
-        end
-        path[#path + 1] = last.pos
-    end, debug.traceback)
-    if not ok then
-        print(errmsg)
     end
-
-    disconnect_to_area(src_area, src_node)
-    disconnect_to_area(dst_area, dst_node)
-
+    -- 起点到第一个连接点, 最后一个连接点到终点都要现算
+    local first = by_id[ids[1]]
+    merge_path(path, self:find_path(src_pos, first.pos))
+    for i = 1, #ids - 1 do
+        local cur_node = by_id[ids[i]]
+        local next_node = by_id[ids[i + 1]]
+        merge_path(path, cur_node.connected[next_node][1])
+    end
+    local last = by_id[ids[#ids]]
+    merge_path(path, self:find_path(last.pos, dst_pos))
+    path[#path + 1] = dst_pos
     return path
 end
 
@@ -875,39 +573,93 @@ local function find_path_start_in_portal(self, from_area_id, from_pos, to_area_i
     return path
 end
 
-function mt:find_path(from_pos, to_pos, check_portal_func, ignore_list)
-    ignore_list = ignore_list or {}
-    if self.core:is_block(mfloor(from_pos.x), mfloor(from_pos.y)) then
-        ignore_list[#ignore_list + 1] = from_pos -- 自动忽略起点
+-- 把第 i 个路点写进 path, 已有的点表直接改坐标
+local function store_point(path, i, x, y)
+    local p = path[i]
+    if p then
+        p.x = x
+        p.y = y
+    else
+        path[i] = { x = x, y = y }
     end
-    for _, pos in pairs(ignore_list) do
-        self.core:clear_block(mfloor(pos.x), mfloor(pos.y))
+end
+
+-- 去掉 path 中第 n 个之后的旧路点
+local function truncate_path(path, n)
+    for i = #path, n + 1, -1 do
+        path[i] = nil
     end
-    local path
+end
+
+local function find_path_impl(self, from_pos, to_pos, out)
     local from_area_id = self:get_area_id_by_pos(from_pos)
     local to_area_id = self:get_area_id_by_pos(to_pos)
-    local ok, errmsg = xpcall(function()
-        if from_area_id == to_area_id then
-            local cpath = self.core:find_path(from_pos.x, from_pos.y, to_pos.x, to_pos.y) or {}
-            path = {}
-            for _, pos in ipairs(cpath) do
-                path[#path + 1] = {
-                    x = pos[1],
-                    y = pos[2]
-                }
-            end
-        elseif from_area_id == 0 then
-            path = find_path_start_in_portal(self, from_area_id, from_pos, to_area_id, to_pos)
-        else
-            path = find_path_cross_area(self, from_area_id, from_pos, to_area_id, to_pos)
+    local path
+    if from_area_id == to_area_id then
+        local n = self.core:find_path_into(path_buf, from_pos.x, from_pos.y, to_pos.x, to_pos.y)
+        path = out or {}
+        for i = 1, n do
+            store_point(path, i, path_buf[2 * i - 1], path_buf[2 * i])
         end
-    end, debug.traceback)
+        truncate_path(path, n)
+        return path
+    elseif from_area_id == 0 then
+        path = find_path_start_in_portal(self, from_area_id, from_pos, to_area_id, to_pos)
+    else
+        path = find_path_cross_area(self, from_area_id, from_pos, to_area_id, to_pos)
+    end
+    if out then
+        -- 跨区域的路径里有缓存的路点, 复制出来, 不能把 out 的点表交给缓存
+        for i = 1, #path do
+            store_point(out, i, path[i].x, path[i].y)
+        end
+        truncate_path(out, #path)
+        return out
+    end
+    return path
+end
+
+--[[
+    out 可选, 传入时结果写进 out 并返回它: out 中已有的点表原地改坐标, 多余的路点清掉,
+    同一个 out 反复用于寻路时每次不再新建表. 返回的路点只在下次用同一个 out 寻路前有效
+]]
+function mt:find_path(from_pos, to_pos, check_portal_func, ignore_list, out)
+    local core = self.core
+    local from_block = core:is_block(mfloor(from_pos.x), mfloor(from_pos.y))
+    -- 临时去掉阻挡时算出的连接点路径可能穿过这些格子, 记下来, 阻挡恢复后退回直线距离
+    local outermost = not self.tainted_segments and (from_block or ignore_list ~= nil)
+    if outermost then
+        self.tainted_segments = {}
+    end
+    if from_block then
+        core:clear_block(mfloor(from_pos.x), mfloor(from_pos.y)) -- 自动忽略起点
+    end
+    if ignore_list then
+        for _, pos in pairs(ignore_list) do
+            core:clear_block(mfloor(pos.x), mfloor(pos.y))
+        end
+    end
+    local ok, path = xpcall(find_path_impl, debug.traceback, self, from_pos, to_pos, out)
     if not ok then
-        print(errmsg)
+        print(path)
+        path = out or {}
+        truncate_path(path, 0)
     end
 
-    for _, pos in pairs(ignore_list) do
-        self.core:add_block(mfloor(pos.x), mfloor(pos.y))
+    if ignore_list then
+        for _, pos in pairs(ignore_list) do
+            core:add_block(mfloor(pos.x), mfloor(pos.y))
+        end
+    end
+    if from_block then
+        core:add_block(mfloor(from_pos.x), mfloor(from_pos.y))
+    end
+    if outermost then
+        local tainted = self.tainted_segments
+        self.tainted_segments = nil
+        for i = 1, #tainted, 2 do
+            connect_nodes(self, tainted[i], tainted[i + 1])
+        end
     end
     if #path < 2 then
         print(string.format("cannot find path (%s, %s) =>(%s, %s)", from_pos.x, from_pos.y, to_pos.x, to_pos.y))
@@ -0,0 +1,67 @@
+#ifndef __OPENSET_H__
+#define __OPENSET_H__ 0
+
+#include "dheap.h"
+#include "fibheap.h"
+#include "map.h"
+
+/*
+    按 s->open_list 在斐波那契堆和4叉堆之间切换的 open_set 操作,
+    格子到堆节点的映射都存放在 s->open_set_map 里. 4叉堆模式下 open_set 参数不用, 可以传 NULL
+*/
+
+static inline struct node_data *open_set_find(SearchContext *s, int pos) {
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        int slot = ((int *)s->open_set_map)[pos];
+        return slot ? s->open_heap.nodes[slot - 1] : NULL;
+    }
+    struct heap_node *p = s->open_set_map[pos];
+    return p ? p->data : NULL;
+}
+
+static inline void open_set_push(struct heap *open_set, SearchContext *s, struct node_data *node) {
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        dheap_insert(&s->open_heap, node);
+    } else {
+        s->open_set_map[node->pos] = fibheap_insert(open_set, node);
+    }
+}
+
+static inline void open_set_decrease(struct heap *open_set, SearchContext *s, struct node_data *node) {
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        dheap_decrease(&s->open_heap, node);
+    } else {
+        fibheap_decrease(open_set, s->open_set_map[node->pos]);
+    }
+}
+
+static inline struct node_data *open_set_pop(struct heap *open_set, SearchContext *s) {
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        return dheap_pop(&s->open_heap);
+    }
+    struct node_data *node = fibheap_pop(open_set);
+    if (node) {
+        s->open_set_map[node->pos] = NULL;
+    }
+    return node;
+}
+
+static inline struct node_data *open_set_peek(struct heap *open_set, SearchContext *s) {
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        return s->open_heap.size ? s->open_heap.nodes[0] : NULL;
+    }
+    return open_set->the_one ? open_set->the_one->data : NULL;
+}
+
+// 首次访问时才初始化格子的寻路状态, 代替每次寻路前的整图 memset
+static inline void touch(SearchContext *s, int pos) {
+    s->gen[pos] = s->search_gen;
+    s->comefrom[pos] = -1;
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        ((int *)s->open_set_map)[pos] = 0;
+    } else {
+        s->open_set_map[pos] = NULL;
+    }
+}
+
+#endif /* __OPENSET_H__ */
@@ -0,0 +1,310 @@
+#include <math.h>
+#include <time.h>
+
+#include "connected.h"
+#include "hpa.h"
+#include "jps.h"
+#include "map.h"
+#include "path.h"
+#include "smooth.h"
+#include "theta.h"
+
+static void push_fpos(SearchContext* s, float fx, float fy) {
+    if (s->fpath_len >= s->fpath_cap) {
+        s->fpath_cap *= 2;
+        s->fpath = (float*)realloc(s->fpath, sizeof(float) * 2 * s->fpath_cap);
+    }
+    s->fpath[2 * s->fpath_len] = fx;
+    s->fpath[2 * s->fpath_len + 1] = fy;
+    s->fpath_len++;
+}
+
+static void find_walkable_point_in_cell(Map* m, int center_pos, float fx1, float fy1,
+    float fx2, float fy2, float* x, float* y) {
+    int x0, y0, ix, iy;
+    float fx0, fy0;
+    pos2xy(m, center_pos, &ix, &iy);
+
+    for(x0 = ix; x0 <= ix + 1; x0 ++) {
+        for(y0 = iy; y0 <= iy + 1; y0 ++) {
+            fx0 = x0 == ix ? x0 - 0.1 : x0 + 0.1;
+            fy0 = y0 == iy ? y0 - 0.1 : y0 + 0.1;
+            if(find_line_obstacle(m, fx0, fy0, fx1, fy1) < 0 && find_line_obstacle(m, fx0, fy0, fx2, fy2) < 0) {
+                *x = x0;
+                *y = y0;
+                return;
+            }
+        }
+    }
+}
+
+static void form_fpath(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2) {
+    int i, ix, iy;
+    float fx, fy;
+    s->fpath_len = 0;
+    if (s->ipath_len < 2) {
+        return;
+    }
+
+    push_fpos(s, fx1, fy1);
+    pos2xy(m, s->ipath[s->ipath_len - 2], &ix, &iy);
+
+    int obs_pos = find_line_obstacle(m, fx1, fy1, ix + 0.5, iy + 0.5);
+    if (obs_pos >= 0) {
+        // 插入起点到第二个路点间的拐点
+        fx = -1;
+        fy = -1;
+        find_walkable_point_in_cell(m, obs_pos, ix + 0.5, iy + 0.5, fx1, fy1, &fx, &fy);
+        if(fx >= 0 && fy >= 0) {
+            push_fpos(s, fx, fy);
+        }
+    }
+
+    for (i = s->ipath_len - 2; i >= 1; i--) {
+        pos2xy(m, s->ipath[i], &ix, &iy);
+        push_fpos(s, ix + 0.5, iy + 0.5);
+    }
+
+    if (s->ipath_len > 2) {
+        // 插入倒数第二个路点到终点间的拐点
+        obs_pos = find_line_obstacle(m, ix + 0.5, iy + 0.5, fx2, fy2);
+        if (obs_pos >= 0) {
+            fx = -1;
+            fy = -1;
+            find_walkable_point_in_cell(m, obs_pos, ix + 0.5, iy + 0.5, fx2, fy2, &fx, &fy);
+            if(fx >= 0 && fy >= 0) {
+                push_fpos(s, fx, fy);
+            }
+        }
+    }
+    push_fpos(s, fx2, fy2);
+}
+
+static int insert_mid_jump_point(Map* m, SearchContext* s, int cur, int father) {
+    int w = m->width;
+    int dx = cur % w - father % w;
+    int dy = cur / w - father / w;
+    if (dx == 0 || dy == 0) {
+        return 0;
+    }
+    if (dx < 0) {
+        dx = -dx;
+    }
+    if (dy < 0) {
+        dy = -dy;
+    }
+    if (dx == dy) {
+        return 0;
+    }
+    int span = dx;
+    if (dy < dx) {
+        span = dy;
+    }
+    int mx = 0, my = 0;
+    if (cur % w < father % w && cur / w < father / w) {
+        mx = father % w - span;
+        my = father / w - span;
+    } else if (cur % w < father % w && cur / w > father / w) {
+        mx = father % w - span;
+        my = father / w + span;
+    } else if (cur % w > father % w && cur / w < father / w) {
+        mx = father % w + span;
+        my = father / w - span;
+    } else if (cur % w > father % w && cur / w > father / w) {
+        mx = father % w + span;
+        my = father / w + span;
+    }
+    push_pos_to_ipath(s, xy2pos(m, mx, my));
+    return 1;
+}
+
+void append_ipath(Map* m, SearchContext* s, int last) {
+    int pos = last;
+    while (s->comefrom[pos] != -1) {
+        push_pos_to_ipath(s, pos);
+        insert_mid_jump_point(m, s, pos, s->comefrom[pos]);
+        pos = s->comefrom[pos];
+    }
+}
+
+void form_ipath(Map* m, SearchContext* s, int last) {
+    s->ipath_len = 0;
+    append_ipath(m, s, last);
+    push_pos_to_ipath(s, s->start);
+}
+
+// 从 last 沿 comefrom 生成 ipath, 任意角度寻路的 comefrom 已经是拐点序列, 原样拷出
+static void form_search_ipath(Map* m, SearchContext* s, int last) {
+    if (s->search != SEARCH_THETA) {
+        form_ipath(m, s, last);
+        return;
+    }
+    s->ipath_len = 0;
+    for (; last != -1; last = s->comefrom[last]) {
+        push_pos_to_ipath(s, last);
+    }
+}
+
+/*
+    双向寻路: 取两侧 meet 中较短的一个, 记为正向访问过的 a 与反向访问过的 b,
+    终点到 b 沿反向搜索的 comefrom, a 到起点沿正向的 comefrom.
+    a 与 b 之间的拐点从发现相遇的一侧的节点开始先走斜线
+*/
+static void form_bidir_ipath(Map* m, SearchContext* s) {
+    SearchContext* r = s->reverse;
+    int a, b, from, i;
+    if (s->start == s->end) {
+        form_ipath(m, s, s->end);
+        return;
+    }
+    if (s->meet_g <= r->meet_g) {
+        a = from = s->meet_from;
+        b = s->meet;
+    } else {
+        a = r->meet;
+        b = from = r->meet_from;
+    }
+    form_ipath(m, r, b);
+    s->ipath_len = 0;
+    for (i = r->ipath_len - 1; i >= 0; i--) {
+        push_pos_to_ipath(s, r->ipath[i]);
+    }
+    if (a == b) {
+        s->ipath_len--;
+    } else {
+        insert_mid_jump_point(m, s, from == a ? b : a, from);
+    }
+    append_ipath(m, s, a);
+    push_pos_to_ipath(s, s->start);
+}
+
+// 根据搜索的返回值生成 ipath, 没搜完时生成到 closest 的部分路径
+static int finish_search(Map* m, SearchContext* s, int ret) {
+    s->partial = 0;
+    if (ret >= 0) {
+        if (s->search == SEARCH_BIDIR) {
+            form_bidir_ipath(m, s);
+        } else {
+            form_search_ipath(m, s, ret);
+        }
+        return 1;
+    }
+    if (ret == SEARCH_PENDING && s->closest != s->start) {
+        form_search_ipath(m, s, s->closest);
+        s->partial = 1;
+        return 1;
+    }
+    return 0;
+}
+
+int search_ipath(Map* m, SearchContext* s) {
+    if (s->search == SEARCH_THETA) {
+        return finish_search(m, s, theta_find_path(m, s));
+    }
+    if (s->search == SEARCH_BIDIR) {
+        return finish_search(m, s, jps_bidir_find_path(m, s));
+    }
+    if (m->hpa && hpa_find_path(m, s)) {
+        s->partial = 0;
+        return 1;
+    }
+    return finish_search(m, s, jps_find_path(m, s));
+}
+
+static inline int same_cell(float fx1, float fy1, float fx2, float fy2) {
+    return floor(fx1) == floor(fx2) && floor(fy1) == floor(fy2);
+}
+
+// 设置起点终点并做寻路前的检查, 返回 SEARCH_PENDING 表示需要搜索
+static int check_query(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2) {
+    s->fpath_len = 0;
+    s->partial = 0;
+    s->start = xy2pos(m, fx1, fy1);
+    s->end = xy2pos(m, fx2, fy2);
+    if (same_cell(fx1, fy1, fx2, fy2)) {
+        return s->end;
+    }
+    if (map_blocked(m, s->start) || map_blocked(m, s->end)) {
+        return SEARCH_NONE;
+    }
+    if (map_connected_id(m, s->start) != map_connected_id(m, s->end)) {
+        return SEARCH_NONE;
+    }
+    return SEARCH_PENDING;
+}
+
+// ipath 生成之后平滑并转成浮点路点, 部分路径停在 closest 的格子中心
+static void ipath_to_fpath(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2, int smooth) {
+    // 任意角度路径本身已经拉直
+    smooth_ipath(m, s, s->search == SEARCH_THETA ? SMOOTH_NONE : smooth);
+    if (s->partial) {
+        int x, y;
+        pos2xy(m, s->ipath[0], &x, &y);
+        fx2 = x + 0.5;
+        fy2 = y + 0.5;
+    }
+    form_fpath(m, s, fx1, fy1, fx2, fy2);
+}
+
+int find_fpath(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2, int smooth) {
+    int ret = check_query(m, s, fx1, fy1, fx2, fy2);
+    if (ret >= 0) {
+        push_fpos(s, fx1, fy1);
+        push_fpos(s, fx2, fy2);
+    } else if (ret == SEARCH_PENDING && search_ipath(m, s)) {
+        ipath_to_fpath(m, s, fx1, fy1, fx2, fy2, smooth);
+    }
+    return s->fpath_len;
+}
+
+int search_begin(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2) {
+    int ret = check_query(m, s, fx1, fy1, fx2, fy2);
+    if (ret != SEARCH_PENDING) {
+        return ret;
+    }
+    if (s->search == SEARCH_THETA) {
+        return theta_start(m, s);
+    }
+    return s->search == SEARCH_BIDIR ? jps_bidir_start(m, s) : jps_start(m, s);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int search_step(Map* m, SearchContext* s, int n, int budget_us) {
+    int (*step)(Map*, SearchContext*, int) = jps_step;
+    if (s->search == SEARCH_THETA) {
+        step = theta_step;
+    } else if (s->search == SEARCH_BIDIR) {
+        step = jps_bidir_step;
+    }
+    if (n <= 0) {
+        n = INT_MAX;
+    }
+    if (budget_us <= 0) {
+        return step(m, s, n);
+    }
+    double deadline = now_us() + budget_us;
+    for (;;) {
+        int k = n < SEARCH_SLICE ? n : SEARCH_SLICE;
+        int ret = step(m, s, k);
+        n -= k;
+        if (ret != SEARCH_PENDING || n <= 0 || now_us() >= deadline) {
+            return ret;
+        }
+    }
+}
+
+int search_fpath(Map* m, SearchContext* s, int ret, float fx1, float fy1, float fx2, float fy2, int smooth) {
+    s->fpath_len = 0;
+    if (same_cell(fx1, fy1, fx2, fy2)) {
+        push_fpos(s, fx1, fy1);
+        push_fpos(s, fx2, fy2);
+    } else if (finish_search(m, s, ret)) {
+        ipath_to_fpath(m, s, fx1, fy1, fx2, fy2, smooth);
+    }
+    return s->fpath_len;
+}
@@ -0,0 +1,39 @@
+#ifndef __PATH_H__
+#define __PATH_H__ 0
+
+#include "map.h"
+
+void form_ipath(Map* m, SearchContext* s, int last);
+// 把从 last 沿 comefrom 回溯到起点(不含起点)的路点追加到 s->ipath
+void append_ipath(Map* m, SearchContext* s, int last);
+
+/*
+    从 s->start 寻路到 s->end, 开启了分层寻路且两点离得够远时先走抽象图,
+    找到路径时整型路点写入 s->ipath 并返回 1.
+    展开节点数达到 s->max_expanded 时写入到 s->closest 的部分路径, 同样返回 1, 并置 s->partial
+*/
+int search_ipath(Map* m, SearchContext* s);
+
+/*
+    用上下文 s 寻路并生成浮点路点, 结果按 x, y 交替写入 s->fpath, 返回路点数,
+    起点或终点在阻挡里、不连通、找不到路径时返回 0.
+    起点终点必须在地图内, 由调用方检查. smooth 为 smooth.h 中的 SMOOTH_* 平滑方式
+*/
+int find_fpath(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2, int smooth);
+
+// 按时间分步寻路时, 每展开这么多节点看一次时钟
+#define SEARCH_SLICE 256
+
+/*
+    分步寻路, 不走分层寻路: search_begin 检查起点终点并开始搜索, 之后反复调用 search_step,
+    每次最多展开 n 个节点(<= 0 表示不限)、最多用 budget_us 微秒(<= 0 表示不限时).
+    两者都返回终点(找到路径)、SEARCH_NONE 或 SEARCH_PENDING(下次可以继续).
+    search_fpath 按最后一次的返回值 ret 生成浮点路点并返回路点数,
+    ret 为 SEARCH_PENDING 时生成到目前离终点最近节点的部分路径.
+    两次调用之间不能用同一个 s 做别的寻路
+*/
+int search_begin(Map* m, SearchContext* s, float fx1, float fy1, float fx2, float fy2);
+int search_step(Map* m, SearchContext* s, int n, int budget_us);
+int search_fpath(Map* m, SearchContext* s, int ret, float fx1, float fy1, float fx2, float fy2, int smooth);
+
+#endif /* __PATH_H__ */
@@ -0,0 +1,189 @@
+#include <pthread.h>
+
+#include "hpa.h"
+#include "path.h"
+#include "pool.h"
+#include "smooth.h"
+
+struct path_worker {
+    struct path_pool* pool;
+    SearchContext* ctx;
+    SearchContext own;
+    float* out; // 本线程处理的所有查询的路点
+    int out_len;
+    int out_cap;
+    pthread_t tid;
+};
+
+struct path_pool {
+    Map* m;
+    int nworkers;
+    struct path_worker* workers;
+    struct path_query* queries;
+    int nqueries;
+    int queries_cap;
+    int next; // 下一条待处理的查询, 各线程原子递增领取
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    int round; // 每批查询加一, 用来唤醒工作线程
+    int busy; // 还没做完本批查询的工作线程数
+    int quit;
+};
+
+static void push_result(struct path_worker* w, const float* path, int n) {
+    if (w->out_len + n > w->out_cap) {
+        while (w->out_len + n > w->out_cap) {
+            w->out_cap *= 2;
+        }
+        w->out = (float*)realloc(w->out, w->out_cap * sizeof(float));
+    }
+    memcpy(w->out + w->out_len, path, n * sizeof(float));
+    w->out_len += n;
+}
+
+static void run_queries(struct path_worker* w) {
+    struct path_pool* pool = w->pool;
+    SearchContext* s = w->ctx;
+    int i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < pool->nqueries) {
+        struct path_query* q = &pool->queries[i];
+        int n = find_fpath(pool->m, s, q->fx1, q->fy1, q->fx2, q->fy2, SMOOTH_FULL);
+        q->worker = w - pool->workers;
+        q->offset = w->out_len;
+        q->count = n;
+        q->partial = n > 0 && s->partial;
+        push_result(w, s->fpath, n * 2);
+    }
+}
+
+static void* worker_main(void* arg) {
+    struct path_worker* w = arg;
+    struct path_pool* pool = w->pool;
+    int round = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->round == round) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        round = pool->round;
+        pthread_mutex_unlock(&pool->lock);
+        run_queries(w);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+struct path_pool* path_pool_create(Map* m, int nthreads) {
+    struct path_pool* pool = (struct path_pool*)calloc(1, sizeof(struct path_pool));
+    pool->m = m;
+    pool->nworkers = nthreads;
+    pool->workers = (struct path_worker*)calloc(nthreads, sizeof(struct path_worker));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    int i;
+    for (i = 0; i < nthreads; i++) {
+        struct path_worker* w = &pool->workers[i];
+        w->pool = pool;
+        w->out_cap = 256;
+        w->out = (float*)malloc(w->out_cap * sizeof(float));
+        if (i == 0) {
+            w->ctx = &m->ctx;
+        } else {
+            search_ctx_init(&w->own, m->width * m->height);
+            w->ctx = &w->own;
+            pthread_create(&w->tid, NULL, worker_main, w);
+        }
+    }
+    return pool;
+}
+
+void path_pool_destroy(struct path_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+    int i;
+    for (i = 0; i < pool->nworkers; i++) {
+        struct path_worker* w = &pool->workers[i];
+        if (i > 0) {
+            pthread_join(w->tid, NULL);
+            search_ctx_destroy(&w->own);
+        }
+        free(w->out);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool->queries);
+    free(pool);
+}
+
+size_t path_pool_memory(struct path_pool* pool) {
+    size_t bytes = sizeof(struct path_pool) + pool->nworkers * sizeof(struct path_worker) +
+                   pool->queries_cap * sizeof(struct path_query);
+    int i;
+    for (i = 0; i < pool->nworkers; i++) {
+        struct path_worker* w = &pool->workers[i];
+        bytes += w->out_cap * sizeof(float);
+        if (i > 0) {
+            bytes += search_ctx_memory(&w->own);
+        }
+    }
+    return bytes;
+}
+
+struct path_query* path_pool_queries(struct path_pool* pool, int n) {
+    if (n > pool->queries_cap) {
+        pool->queries_cap = n;
+        pool->queries = (struct path_query*)realloc(pool->queries, n * sizeof(struct path_query));
+    }
+    pool->nqueries = n;
+    return pool->queries;
+}
+
+void path_pool_run(struct path_pool* pool) {
+    int i;
+    if (pool->m->hpa) {
+        // 工作线程只读抽象图
+        hpa_refresh(pool->m);
+    }
+    for (i = 0; i < pool->nworkers; i++) {
+        pool->workers[i].out_len = 0;
+        pool->workers[i].ctx->open_list = pool->m->ctx.open_list;
+        pool->workers[i].ctx->search = pool->m->ctx.search;
+        pool->workers[i].ctx->max_expanded = pool->m->ctx.max_expanded;
+    }
+    pool->next = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->busy = pool->nworkers - 1;
+    pool->round++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_queries(&pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+const float* path_pool_result(struct path_pool* pool, int i, int* count, int* partial) {
+    struct path_query* q = &pool->queries[i];
+    *count = q->count;
+    *partial = q->partial;
+    return pool->workers[q->worker].out + q->offset;
+}
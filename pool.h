@@ -0,0 +1,31 @@
+#ifndef __POOL_H__
+#define __POOL_H__ 0
+
+#include "map.h"
+
+// 批量寻路中的一条查询, 结果由执行它的线程写在自己的输出缓冲里
+struct path_query {
+    float fx1, fy1, fx2, fy2;
+    int worker; // 结果所在的线程
+    int offset; // 结果在该线程输出缓冲中的下标
+    int count; // 路点数, 找不到路径为 0
+    char partial; // 超过展开节点数上限, 结果是到最接近终点处的部分路径
+};
+
+/*
+    nthreads 个线程共同处理一批查询, 其中一个是调用方所在的线程, 使用 m->ctx,
+    其余每个线程各自持有一份完整的 SearchContext
+*/
+struct path_pool* path_pool_create(Map* m, int nthreads);
+void path_pool_destroy(struct path_pool* pool);
+// 线程池自己的缓冲, 不包括调用线程使用的 m->ctx
+size_t path_pool_memory(struct path_pool* pool);
+
+// 准备 n 条查询的空间, 返回的数组由调用方填写起点终点
+struct path_query* path_pool_queries(struct path_pool* pool, int n);
+// 分发所有查询, 全部完成后才返回
+void path_pool_run(struct path_pool* pool);
+// 第 i 条查询的路点, x, y 交替存放, 路点数在 count 中返回, 是否部分路径在 partial 中返回
+const float* path_pool_result(struct path_pool* pool, int i, int* count, int* partial);
+
+#endif /* __POOL_H__ */
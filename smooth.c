@@ -1,7 +1,62 @@
 
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "smooth.h"
 #include "map.h"
+#include "tile.h"
+
+// 视线检测先把坐标换成 1/LOS_ONE 格精度的定点数, 之后全是整数运算
+#define LOS_SHIFT 10
+#define LOS_ONE (1 << LOS_SHIFT)
+// 每次从位图读一个字检查的格子数
+#define LOS_STEP 56
+
+static inline int64_t floor_div(int64_t a, int64_t b) {
+    int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+/*
+    在 [a, b] 这段格子里找阻挡, backward 为真时从 b 往 a 找.
+    row_bit 为这一行第 0 格在位图中的下标
+*/
+static int run_blocked(const char* bits, int row_bit, int a, int b, int backward) {
+    int lo, n;
+    if (!backward) {
+        for (lo = a; lo <= b; lo += LOS_STEP) {
+            n = b - lo + 1 < LOS_STEP ? b - lo + 1 : LOS_STEP;
+            uint64_t v = bitmap_load(bits, row_bit + lo) & ((1ULL << n) - 1);
+            if (v) {
+                return lo + __builtin_ctzll(v);
+            }
+        }
+    } else {
+        int hi;
+        for (hi = b; hi >= a; hi -= LOS_STEP) {
+            lo = hi - LOS_STEP + 1 > a ? hi - LOS_STEP + 1 : a;
+            n = hi - lo + 1;
+            uint64_t v = bitmap_load(bits, row_bit + lo) & ((1ULL << n) - 1);
+            if (v) {
+                return lo + 63 - __builtin_clzll(v);
+            }
+        }
+    }
+    return -1;
+}
+
+// 从定点坐标 p 出发沿 d 的方向走一点点所在的格子
+static inline int leave_cell(int64_t p, int64_t d) {
+    return floor_div(d < 0 ? p - 1 : p, LOS_ONE);
+}
 
+/*
+    返回线段经过的第一个阻挡格, 没有阻挡返回 -1.
+    按行(线段更陡时用转置位图按列)遍历: 线段在每一行覆盖的格子是连续的一段,
+    由它进出这一行的两个交点算出来, 整段用按字读取的位图检查
+*/
 int find_line_obstacle(Map* m, float x1, float y1, float x2, float y2) {
     if (!map_walkable(m, xy2pos(m, (int)x1, (int)y1))) {
         return xy2pos(m, (int)x1, (int)y1);
@@ -9,57 +64,141 @@ int find_line_obstacle(Map* m, float x1, float y1, float x2, float y2) {
     if(!map_walkable(m, xy2pos(m, (int)x2, (int)y2))) {
         return xy2pos(m, (int)x2, (int)y2);
     }
-    float k = (y2 - y1) / (x2 - x1);
-
-    int min_x = x1 < x2 ? (int)x1 : (int)x2;
-    int max_x = x1 < x2 ? (int)x2 : (int)x1;
-    int min_y = y1 < y2 ? (int)y1 : (int)y2;
-    int max_y = y1 < y2 ? (int)y2 : (int)y1;
-
-    int x, y;
-    // printf("find_line_obstacle %d %d\n", min_x, max_x);
-    for (x = min_x + 1; x <= max_x; ++x) {
-        y = (int)(k * ((float)x - x1) + y1);
-        if (!map_walkable(m, xy2pos(m, x, y))) {
-            return xy2pos(m, x, y);
+    // 下面检查的格子都在两端点围成的矩形内, 矩形覆盖的分块都没有阻挡时不用逐格检查
+    if (m->tiles && tiles_rect_clear(m->tiles, x1 < x2 ? (int)x1 : (int)x2, y1 < y2 ? (int)y1 : (int)y2,
+                                     x1 < x2 ? (int)x2 : (int)x1, y1 < y2 ? (int)y2 : (int)y1)) {
+        return -1;
+    }
+    int64_t ax = llroundf(x1 * LOS_ONE), ay = llroundf(y1 * LOS_ONE);
+    int64_t bx = llroundf(x2 * LOS_ONE), by = llroundf(y2 * LOS_ONE);
+    // u 为沿行的坐标, v 为行号; 线段更陡时交换, 改用转置位图
+    int steep = llabs(by - ay) > llabs(bx - ax);
+    int64_t au = steep ? ay : ax, av = steep ? ax : ay;
+    int64_t bu = steep ? by : bx, bv = steep ? bx : by;
+    const char* bits = steep ? m->tm : m->m;
+    int ulen = steep ? m->height : m->width;
+    int vlen = steep ? m->width : m->height;
+    int64_t du = bu - au, dv = bv - av;
+    int sv = dv < 0 ? -1 : 1;
+    int v = floor_div(av, LOS_ONE), v1 = floor_div(bv, LOS_ONE);
+    int lo, hi, in_lo, in_hi, out_lo, out_hi;
+    in_lo = in_hi = floor_div(au, LOS_ONE);
+    if (v != v1 && sv < 0 && av == (int64_t)v * LOS_ONE) {
+        // 起点正好在网格线上, 这一行只碰到起点
+        in_lo = in_hi = leave_cell(au, du);
+        v--;
+    }
+    /*
+        线段与网格线 v = V 的交点 u 坐标为 num / den 个格子, q 和 r 是商和余数,
+        每往前过一条网格线 num 增加 du * LOS_ONE, 用整数累加代替除法.
+        交点恰好在格点上(r 为 0)时两侧的格子都算, 保证不会从两个斜对的阻挡之间穿过去
+    */
+    int64_t V = (int64_t)(sv > 0 ? v + 1 : v) * LOS_ONE;
+    int64_t den = llabs(dv) * LOS_ONE;
+    int64_t q = 0, r = 0, qi = 0, ri = 0;
+    if (v != v1) {
+        int64_t num = au * llabs(dv) + du * llabs(V - av);
+        q = floor_div(num, den);
+        r = num - q * den;
+        qi = floor_div(du * LOS_ONE, den);
+        ri = du * LOS_ONE - qi * den;
+    }
+    for (;; v += sv) {
+        if (v == v1) {
+            out_lo = out_hi = floor_div(bu, LOS_ONE);
+        } else if (V == bv) {
+            // 终点正好在网格线上, 下一行只碰到终点, 不用再查
+            out_lo = out_hi = leave_cell(bu, -du);
+        } else {
+            out_lo = r == 0 ? q - 1 : q;
+            out_hi = q;
         }
-        if (!map_walkable(m, xy2pos(m, x - 1, y))) {
-            return xy2pos(m, x - 1, y);
+        lo = in_lo < out_lo ? in_lo : out_lo;
+        hi = in_hi > out_hi ? in_hi : out_hi;
+        if (lo < 0) {
+            lo = 0;
         }
-    }
-
-    for (y = min_y + 1; y <= max_y; ++y) {
-        x = (int)((y - y1) / k + x1);
-        if (!map_walkable(m, xy2pos(m, x, y))) {
-            return xy2pos(m, x, y);
+        if (hi > ulen - 1) {
+            hi = ulen - 1;
+        }
+        if (v >= 0 && v < vlen && lo <= hi) {
+            int u = run_blocked(bits, (v + 1) * (ulen + 2) + 1, lo, hi, du < 0);
+            if (u >= 0) {
+                return steep ? v + u * m->width : u + v * m->width;
+            }
         }
-        if (!map_walkable(m, xy2pos(m, x, y - 1))) {
-            return xy2pos(m, x, y - 1);
+        if (v == v1 || V == bv) {
+            return -1;
+        }
+        // 出这一行的交点就是进下一行的交点
+        in_lo = out_lo;
+        in_hi = out_hi;
+        V += sv * LOS_ONE;
+        q += qi;
+        r += ri;
+        if (r >= den) {
+            q++;
+            r -= den;
         }
     }
-
-    return -1;
 }
 
-void smooth_path(Map* m) {
+void smooth_path(Map* m, SearchContext* s) {
     int x1, y1, x2, y2;
-    for (int i = m->ipath_len - 1; i >= 0; i--) {
+    for (int i = s->ipath_len - 1; i >= 0; i--) {
         for (int j = 0; j < i - 1; j++) {
-            pos2xy(m, m->ipath[i], &x1, &y1);
-            pos2xy(m, m->ipath[j], &x2, &y2);
-            // printf("check (%d)%d <=> (%d)%d\n", i, m->ipath[i], j, m->ipath[j]);
+            pos2xy(m, s->ipath[i], &x1, &y1);
+            pos2xy(m, s->ipath[j], &x2, &y2);
+            // printf("check (%d)%d <=> (%d)%d\n", i, s->ipath[i], j, s->ipath[j]);
             if (find_line_obstacle(m, x1 + 0.5, y1 + 0.5, x2 + 0.5,
                                     y2 + 0.5) < 0) {
                 int offset = i - j - 1;
                 // printf("merge (%d) to (%d) offset:%d\n", i, j, offset);
-                for (int k = j + 1; k <= m->ipath_len - 1 - offset; k++) {
-                    m->ipath[k] = m->ipath[k + offset];
+                for (int k = j + 1; k <= s->ipath_len - 1 - offset; k++) {
+                    s->ipath[k] = s->ipath[k + offset];
                     // printf("%d <= %d\n", k, k + offset);
                 }
-                m->ipath_len -= offset;
+                s->ipath_len -= offset;
                 i = j + 1;
                 break;
             }
         }
     }
 }
+
+/*
+    单遍贪心拉绳: 从锚点往终点方向逐个看下一个路点, 看得见就继续往前, 看不见就把当前路点定为新锚点.
+    每个路点只做一次视线检测, 保留的路点原地往高下标处压紧, 最后整体挪回数组开头.
+    结果不会比原路径长, 但只认"连续可见"的前缀, 看不到隔着遮挡之后又能看见的更远路点,
+    所以不是 smooth_path 的等价替代: 路径通常略长, 拐点也可能多几个. 不是漏斗算法
+*/
+void smooth_path_linear(Map* m, SearchContext* s) {
+    int n = s->ipath_len;
+    if (n <= 2) {
+        return;
+    }
+    int x1, y1, x2, y2;
+    // ipath 逆序存放, ipath[n - 1] 是起点
+    int w = n - 1;
+    int anchor = s->ipath[n - 1];
+    pos2xy(m, anchor, &x1, &y1);
+    for (int k = n - 2; k > 0; k--) {
+        pos2xy(m, s->ipath[k - 1], &x2, &y2);
+        if (find_line_obstacle(m, x1 + 0.5, y1 + 0.5, x2 + 0.5, y2 + 0.5) >= 0) {
+            anchor = s->ipath[k];
+            s->ipath[--w] = anchor;
+            pos2xy(m, anchor, &x1, &y1);
+        }
+    }
+    s->ipath[--w] = s->ipath[0];
+    s->ipath_len = n - w;
+    memmove(s->ipath, s->ipath + w, s->ipath_len * sizeof(s->ipath[0]));
+}
+
+void smooth_ipath(Map* m, SearchContext* s, int mode) {
+    if (mode == SMOOTH_FULL) {
+        smooth_path(m, s);
+    } else if (mode == SMOOTH_LINEAR) {
+        smooth_path_linear(m, s);
+    }
+}
@@ -4,6 +4,13 @@
 #include "map.h"
 
 int find_line_obstacle(Map *m, float x1, float y1, float x2, float y2);
-void smooth_path(Map *m);
+void smooth_path(Map *m, SearchContext *s);
+void smooth_path_linear(Map *m, SearchContext *s);
+
+#define SMOOTH_NONE 0
+#define SMOOTH_FULL 1 // 逐对尝试合并路点, 视线检测次数与路点数的平方成正比
+#define SMOOTH_LINEAR 2 // 单遍贪心, 视线检测次数与路点数成正比, 路径通常比 SMOOTH_FULL 略长
+
+void smooth_ipath(Map *m, SearchContext *s, int mode);
 
 #endif /* __SMOOTH_H__ */
\ No newline at end of file
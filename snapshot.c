@@ -0,0 +1,245 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "connected.h"
+#include "jps.h"
+#include "snapshot.h"
+
+static uint64_t align_up(uint64_t n) {
+    return (n + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+// 写到 offset 处, 中间用 0 补齐
+static int write_at(FILE* f, uint64_t* written, uint64_t offset, const void* data, size_t len) {
+    static const char zero[SNAPSHOT_ALIGN];
+    while (*written < offset) {
+        size_t n = offset - *written;
+        if (n > sizeof(zero)) {
+            n = sizeof(zero);
+        }
+        if (fwrite(zero, 1, n, f) != n) {
+            return -1;
+        }
+        *written += n;
+    }
+    if (len > 0 && fwrite(data, 1, len, f) != len) {
+        return -1;
+    }
+    *written += len;
+    return 0;
+}
+
+const char* snapshot_save(Map* m, const char* path) {
+    int len = m->width * m->height;
+    struct snapshot_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+    h.version = SNAPSHOT_VERSION;
+    h.byte_order = SNAPSHOT_BYTE_ORDER;
+    h.width = m->width;
+    h.height = m->height;
+    h.bitmap_len = BITMAP_LEN(m->width, m->height);
+    h.max_connected_id = m->mark_connected;
+    h.bitmap_offset = align_up(sizeof(h));
+    h.tm_offset = align_up(h.bitmap_offset + h.bitmap_len);
+    h.connected_size = m->mark_connected > CONNECTED_NARROW_MAX ? sizeof(int) : sizeof(unsigned short);
+    h.connected_offset = align_up(h.tm_offset + h.bitmap_len);
+    if (m->jump_table) {
+        h.flags |= SNAPSHOT_JUMP_TABLE;
+        h.jump_offset = align_up(h.connected_offset + (uint64_t)len * h.connected_size);
+    }
+
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return strerror(errno);
+    }
+    uint64_t written = 0;
+    int err = write_at(f, &written, 0, &h, sizeof(h));
+    err = err || write_at(f, &written, h.bitmap_offset, m->m, h.bitmap_len);
+    err = err || write_at(f, &written, h.tm_offset, m->tm, h.bitmap_len);
+    // 并查集展开成每格的区域 id 再写, 加载时不需要并查集
+    int buf[1024];
+    unsigned short narrow[1024];
+    int i, k, n = 0;
+    err = err || write_at(f, &written, h.connected_offset, NULL, 0);
+    for (i = 0; i < len && !err; i++) {
+        buf[n++] = map_connected_id(m, i);
+        if (n == sizeof(buf) / sizeof(buf[0]) || i == len - 1) {
+            if (h.connected_size == sizeof(int)) {
+                err = write_at(f, &written, written, buf, n * sizeof(int));
+            } else {
+                for (k = 0; k < n; k++) {
+                    narrow[k] = buf[k];
+                }
+                err = write_at(f, &written, written, narrow, n * sizeof(unsigned short));
+            }
+            n = 0;
+        }
+    }
+    if (m->jump_table) {
+        err = err || write_at(f, &written, h.jump_offset, m->jump_table, (size_t)len * 8);
+    }
+    if (fclose(f) != 0) {
+        err = 1;
+    }
+    return err ? "write snapshot failed" : NULL;
+}
+
+// offset 开始的 len 字节是否都在文件内, 不会溢出
+static int in_file(uint64_t offset, uint64_t len, size_t size) {
+    return offset <= size && len <= size - offset;
+}
+
+/*
+    文件内容不可信, 大小都按 64 位计算. 格子下标和位图的位下标在地图里都是 int,
+    带跳点表时 pos * 8 也要放得下
+*/
+static const char* check_header(const struct snapshot_header* h, size_t size) {
+    if (size < sizeof(*h) || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0) {
+        return "not a map snapshot";
+    }
+    if (h->version != SNAPSHOT_VERSION) {
+        return "unsupported snapshot version";
+    }
+    if (h->byte_order != SNAPSHOT_BYTE_ORDER) {
+        return "snapshot byte order mismatch";
+    }
+    if (h->width <= 0 || h->height <= 0) {
+        return "bad snapshot size";
+    }
+    uint64_t len = (uint64_t)h->width * h->height;
+    uint64_t bits = (uint64_t)(h->width + 2) * (h->height + 2);
+    if (bits > INT_MAX || ((h->flags & SNAPSHOT_JUMP_TABLE) && len > INT_MAX / 8) ||
+        (uint64_t)h->bitmap_len != bits / CHAR_BIT + 1 + BITMAP_PADDING) {
+        return "bad snapshot size";
+    }
+    if (h->connected_size != sizeof(int) && h->connected_size != sizeof(unsigned short)) {
+        return "bad snapshot connected size";
+    }
+    if (h->max_connected_id < 0 || (uint64_t)h->max_connected_id > len ||
+        (h->connected_size == sizeof(unsigned short) && h->max_connected_id > CONNECTED_NARROW_MAX)) {
+        return "bad snapshot connected id";
+    }
+    if (!in_file(h->bitmap_offset, h->bitmap_len, size) || !in_file(h->tm_offset, h->bitmap_len, size) ||
+        !in_file(h->connected_offset, len * h->connected_size, size) ||
+        h->connected_offset % h->connected_size != 0 ||
+        ((h->flags & SNAPSHOT_JUMP_TABLE) && !in_file(h->jump_offset, len * 8, size))) {
+        return "truncated snapshot";
+    }
+    return NULL;
+}
+
+// 扫描会一直走到边框上的阻挡才停, 边框缺了就会越界
+static int check_border(const char* bits, int width, int height) {
+    int x, y;
+    for (x = 0; x < width + 2; x++) {
+        if (!BITTEST(bits, x) || !BITTEST(bits, (height + 1) * (width + 2) + x)) {
+            return 0;
+        }
+    }
+    for (y = 1; y <= height; y++) {
+        if (!BITTEST(bits, y * (width + 2)) || !BITTEST(bits, y * (width + 2) + width + 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 区域 id 会用来下标并查集, 不能超过文件头里的 max_connected_id
+static int check_connected(const struct snapshot_header* h, const char* base) {
+    int len = h->width * h->height;
+    int i;
+    if (h->connected_size == sizeof(int)) {
+        const int* ids = (const int*)(base + h->connected_offset);
+        for (i = 0; i < len; i++) {
+            if (ids[i] < 0 || ids[i] > h->max_connected_id) {
+                return 0;
+            }
+        }
+    } else {
+        const unsigned short* ids = (const unsigned short*)(base + h->connected_offset);
+        for (i = 0; i < len; i++) {
+            if (ids[i] > h->max_connected_id) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static const char* check_data(const struct snapshot_header* h, const char* base) {
+    if (!check_border(base + h->bitmap_offset, h->width, h->height) ||
+        !check_border(base + h->tm_offset, h->height, h->width)) {
+        return "bad snapshot border";
+    }
+    if (!check_connected(h, base)) {
+        return "bad snapshot connected id";
+    }
+    if ((h->flags & SNAPSHOT_JUMP_TABLE) &&
+        !jps_plus_check((const signed char*)(base + h->jump_offset), h->width, h->height)) {
+        return "bad snapshot jump table";
+    }
+    return NULL;
+}
+
+const char* snapshot_load(Map* m, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return strerror(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return strerror(errno);
+    }
+    size_t size = st.st_size;
+    if (size < sizeof(struct snapshot_header)) {
+        close(fd);
+        return "not a map snapshot";
+    }
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return strerror(errno);
+    }
+    const struct snapshot_header* h = (const struct snapshot_header*)base;
+    const char* err = check_header(h, size);
+    if (!err) {
+        err = check_data(h, (const char*)base);
+    }
+    if (err) {
+        munmap(base, size);
+        return err;
+    }
+    map_init_scratch(m, h->width, h->height);
+    struct snapshot* snap = (struct snapshot*)malloc(sizeof(struct snapshot));
+    snap->base = base;
+    snap->len = size;
+    m->m = (char*)base + h->bitmap_offset;
+    m->tm = (char*)base + h->tm_offset;
+    m->connected = (char*)base + h->connected_offset;
+    m->connected_wide = h->connected_size == sizeof(int);
+    if (h->flags & SNAPSHOT_JUMP_TABLE) {
+        m->jump_table = (signed char*)((char*)base + h->jump_offset);
+    }
+    map_init_grid(m, snap);
+    if (h->max_connected_id > 0) {
+        map_reset_connected(m, h->max_connected_id);
+    }
+    return NULL;
+}
+
+void snapshot_release(struct snapshot* snap) {
+    munmap(snap->base, snap->len);
+}
+
+int snapshot_contains(const struct snapshot* snap, const void* p) {
+    return snap && (const char*)p >= (const char*)snap->base &&
+           (const char*)p < (const char*)snap->base + snap->len;
+}
@@ -0,0 +1,52 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__ 0
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map.h"
+
+/*
+    地图的二进制快照, 依次存放:
+    文件头, 阻挡位图, 转置位图, 每格的连通区域 id(2 或 4 字节), 可选的 JPS+ 跳点表.
+    每段按 SNAPSHOT_ALIGN 对齐, 加载时整个文件以 MAP_PRIVATE 映射进来,
+    地图直接使用映射中的数据, 改阻挡时由内核按页写时复制, 不影响文件
+*/
+#define SNAPSHOT_MAGIC "LNAVSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_ALIGN 64
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+#define SNAPSHOT_JUMP_TABLE 1 // 带 JPS+ 跳点表
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order; // 写入 SNAPSHOT_BYTE_ORDER, 用来拒绝字节序不同的文件
+    int32_t width;
+    int32_t height;
+    int32_t bitmap_len;
+    int32_t max_connected_id; // 0 表示没有标记过连通区域
+    uint32_t flags;
+    uint32_t connected_size; // 每格区域 id 的字节数, 区域不超过 CONNECTED_NARROW_MAX 时为 2
+    uint64_t bitmap_offset;
+    uint64_t tm_offset;
+    uint64_t connected_offset;
+    uint64_t jump_offset;
+};
+
+// 一次映射, 地图释放时解除
+struct snapshot {
+    void* base;
+    size_t len;
+};
+
+// 成功返回 NULL, 失败返回错误信息
+const char* snapshot_save(Map* m, const char* path);
+// 从快照初始化一张新地图
+const char* snapshot_load(Map* m, const char* path);
+void snapshot_release(struct snapshot* snap);
+// p 是否指向快照映射的内存(不能 free)
+int snapshot_contains(const struct snapshot* snap, const void* p);
+
+#endif /* __SNAPSHOT_H__ */
@@ -2,6 +2,7 @@ local navigation = require "navigation.c"
 local M = {}
 
 local nav, x1, y1, x2, y2
+local path_buf = {}
 function M.set_nav(...)
     nav = navigation.new(...)
     return nav
@@ -21,8 +22,12 @@ function M.find_path()
     nav:find_path(x1, y1, x2, y2)
 end
 
+function M.find_path_into()
+    return nav:find_path_into(path_buf, x1, y1, x2, y2)
+end
+
 function M.find_path_by_grid(without_smooth)
-    nav:find_path(x1, y1, x2, y2, without_smooth)
+    nav:find_path_by_grid(x1, y1, x2, y2, without_smooth)
 end
 
 
@@ -36,6 +41,30 @@ function M.print_find_path()
     print("========================")
 end
 
+function M.print_find_path_into()
+    print("========================")
+    print(string.format("find path into (%s, %s) => (%s, %s)", x1, y1, x2, y2))
+    local n = nav:find_path_into(path_buf, x1, y1, x2, y2)
+    for i = 1, n do
+        print(path_buf[2 * i - 1], path_buf[2 * i])
+    end
+    print("========================")
+end
+
+function M.print_find_paths(batch)
+    print("========================")
+    print(string.format("find paths, count:%d", #batch))
+    local ret = nav:find_paths(batch)
+    for i, path in ipairs(ret) do
+        local q = batch[i]
+        print(string.format("(%s, %s) => (%s, %s)", q[1], q[2], q[3], q[4]))
+        for _, v in ipairs(path or {}) do
+            print(v[1], v[2])
+        end
+    end
+    print("========================")
+end
+
 function M.print_find_path_by_grid(without_smooth)
     print("========================")
     print(string.format("find path by grid %s (%s, %s) => (%s, %s)",
@@ -54,8 +83,62 @@ function M.calc_time(func, count)
         func()
     end
     local sum = os.clock() - t
-    print(string.format("run time, count:%d, sum time:%.2f, average:%.2f", count, sum, sum/count))
+    print(string.format("run time, count:%d, sum time:%.2f, average:%.4f", count, sum, sum/count))
+end
+
+-- 与 dist 相同的代价: 直走 5, 斜走 7
+function M.path_cost(path)
+    local c = 0
+    for i = 2, #path do
+        local dx, dy = math.abs(path[i][1] - path[i - 1][1]), math.abs(path[i][2] - path[i - 1][2])
+        c = c + math.min(dx, dy) * 7 + (math.max(dx, dy) - math.min(dx, dy)) * 5
+    end
+    return c
 end
 
+-- 八方向 Dijkstra, 目标格可走就能走过去, 返回起点到各格的最短距离(按 path_cost 的代价), 下标是 x + y * W
+function M.dijkstra(nav, W, H, sx, sy)
+    local d = {[sx + sy * W] = 0}
+    local heap = {{0, sx + sy * W}}
+    while #heap > 0 do
+        local top = heap[1]
+        local last = table.remove(heap)
+        if #heap > 0 then
+            heap[1] = last
+            local i = 1
+            while true do
+                local l, r, m = i * 2, i * 2 + 1, i
+                if l <= #heap and heap[l][1] < heap[m][1] then m = l end
+                if r <= #heap and heap[r][1] < heap[m][1] then m = r end
+                if m == i then break end
+                heap[i], heap[m] = heap[m], heap[i]
+                i = m
+            end
+        end
+        local g, pos = top[1], top[2]
+        if g == d[pos] then
+            local x, y = pos % W, pos // W
+            for dx = -1, 1 do
+                for dy = -1, 1 do
+                    local nx, ny = x + dx, y + dy
+                    if (dx ~= 0 or dy ~= 0) and nx >= 0 and nx < W and ny >= 0 and ny < H
+                            and not nav:is_block(nx, ny) then
+                        local npos, ng = nx + ny * W, g + ((dx ~= 0 and dy ~= 0) and 7 or 5)
+                        if not d[npos] or ng < d[npos] then
+                            d[npos] = ng
+                            heap[#heap + 1] = {ng, npos}
+                            local i = #heap
+                            while i > 1 and heap[i // 2][1] > heap[i][1] do
+                                heap[i], heap[i // 2] = heap[i // 2], heap[i]
+                                i = i // 2
+                            end
+                        end
+                    end
+                end
+            end
+        end
+    end
+    return d
+end
 
 return M
\ No newline at end of file
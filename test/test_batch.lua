@@ -0,0 +1,55 @@
+-- 测试批量寻路, 多线程结果应与单线程完全一致
+local test = require "test.test_api"
+local nav = test.set_nav {
+    w = 500,
+    h = 500,
+    obstacle = {}
+}
+
+math.randomseed(1)
+for i = 1, 50000 do
+    nav:add_block(math.random(0, 499), math.random(0, 499))
+end
+nav:mark_connected()
+
+local batch = {}
+for i = 1, 500 do
+    batch[i] = {
+        math.random(0, 499) + 0.5, math.random(0, 499) + 0.5,
+        math.random(0, 499) + 0.5, math.random(0, 499) + 0.5,
+    }
+end
+
+local function path_str(path)
+    if not path then
+        return "nil"
+    end
+    local s = {}
+    for _, v in ipairs(path) do
+        s[#s + 1] = string.format("(%s, %s)", v[1], v[2])
+    end
+    return table.concat(s, " ")
+end
+
+local expect = {}
+for i, q in ipairs(batch) do
+    expect[i] = path_str(nav:find_path(q[1], q[2], q[3], q[4]))
+end
+
+for _, threads in ipairs {1, 2, 4, 8} do
+    nav:set_threads(threads)
+    local ret
+    print("find_paths, threads:", threads) -- os.clock 统计的是所有线程的 CPU 时间
+    test.calc_time(function ()
+        ret = nav:find_paths(batch)
+    end, 1)
+    local diff = 0
+    for i = 1, #batch do
+        if path_str(ret[i] or nil) ~= expect[i] then
+            diff = diff + 1
+        end
+    end
+    print("diff:", diff)
+    assert(diff == 0)
+end
+nav:set_threads(0)
@@ -0,0 +1,156 @@
+-- 测试双向跳点寻路: 多组随机地图上路径合法, 长度等于 Dijkstra 求出的最短路径, 也与单向跳点寻路相同
+local test = require "test.test_api"
+local W, H = 64, 48
+
+local cost = test.path_cost
+
+-- 相邻路点在同一直线或斜线上, 途经的格子都可走
+local function check_path(nav, path, q)
+    assert(path[1][1] == q[1] and path[1][2] == q[2])
+    assert(path[#path][1] == q[3] and path[#path][2] == q[4])
+    for i = 2, #path do
+        local x, y = path[i - 1][1], path[i - 1][2]
+        local dx, dy = path[i][1] - x, path[i][2] - y
+        assert(dx == 0 or dy == 0 or math.abs(dx) == math.abs(dy))
+        local n = math.max(math.abs(dx), math.abs(dy))
+        local sx, sy = dx == 0 and 0 or dx // math.abs(dx), dy == 0 and 0 or dy // math.abs(dy)
+        for k = 0, n do
+            assert(not nav:is_block(x + sx * k, y + sy * k))
+        end
+    end
+end
+
+local function new_map(seed)
+    local nav = test.set_nav {
+        w = W,
+        h = H,
+        obstacle = {}
+    }
+    math.randomseed(seed)
+    -- 每张图的阻挡密度和房间数不同
+    for i = 1, W * H // (4 + seed % 5) do
+        nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+    end
+    for i = 1, seed % 4 * 3 do
+        local x, y = math.random(0, W - 1), math.random(0, H - 1)
+        for yy = math.max(0, y - 3), math.min(H - 1, y + 3) do
+            for xx = math.max(0, x - 5), math.min(W - 1, x + 5) do
+                nav:add_block(xx, yy)
+            end
+        end
+    end
+    -- 连通区域按四邻域标记, 斜穿两个阻挡之间的路径会被判为不通, 这里不标记
+    return nav
+end
+
+local function new_queries(nav, n)
+    local queries = {}
+    while #queries < n do
+        local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+        local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+        if not nav:is_block(x1, y1) and not nav:is_block(x2, y2) then
+            local d = test.dijkstra(nav, W, H, x1, y1)
+            queries[#queries + 1] = {x1, y1, x2, y2, d[x2 + y2 * W]}
+        end
+    end
+    return queries
+end
+
+local function run(nav, queries, open_list)
+    nav:set_open_list(open_list)
+    local found = 0
+    for i, q in ipairs(queries) do
+        -- 寻路方式是每次调用的最后一个参数, 不改 set_search 设置的默认方式
+        local expect = nav:find_path_by_grid(q[1], q[2], q[3], q[4], "none", "jps")
+        local got = nav:find_path_by_grid(q[1], q[2], q[3], q[4], "none", "bidir")
+        assert((got == nil) == (q[5] == nil), string.format("query %d", i))
+        assert((expect == nil) == (got == nil), string.format("query %d", i))
+        if got then
+            found = found + 1
+            check_path(nav, got, q)
+            assert(cost(got) == q[5], string.format("query %d: bidir %d, optimal %d", i, cost(got), q[5]))
+            assert(cost(expect) == q[5], string.format("query %d: jps %d, optimal %d", i, cost(expect), q[5]))
+            -- 平滑后的浮点路径同样可用
+            assert(nav:find_path(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5, "full", "bidir"))
+        end
+    end
+    return found
+end
+
+local nav, queries
+for seed = 1, 8 do
+    nav = new_map(seed)
+    queries = new_queries(nav, 250)
+    print("seed", seed, "found", run(nav, queries, "fibheap"), run(nav, queries, "dheap"))
+end
+
+-- 双向寻路不查 JPS+ 表, 分块跳过只影响扫描, 结果都不变
+nav:set_jps_plus(true)
+nav:set_tiles(true)
+run(nav, queries, "dheap")
+nav:set_jps_plus(false)
+nav:set_tiles(false)
+
+-- 单次指定的寻路方式与 set_search 设为默认的结果相同, 也不影响之后的默认方式
+local function same(a, b)
+    if a == nil or b == nil then
+        return a == b
+    end
+    if #a ~= #b then
+        return false
+    end
+    for i = 1, #a do
+        if a[i][1] ~= b[i][1] or a[i][2] ~= b[i][2] then
+            return false
+        end
+    end
+    return true
+end
+local buf = {}
+for i = 1, 20 do
+    local q = queries[i]
+    local fx1, fy1, fx2, fy2 = q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5
+    nav:set_search("bidir")
+    local default = nav:find_path(fx1, fy1, fx2, fy2)
+    nav:set_search("theta")
+    local theta = nav:find_path(fx1, fy1, fx2, fy2)
+    assert(same(nav:find_path(fx1, fy1, fx2, fy2, "full", "bidir"), default))
+    assert(same(nav:find_path(fx1, fy1, fx2, fy2), theta))
+    local n = nav:find_path_into(buf, fx1, fy1, fx2, fy2, "full", "bidir")
+    assert(n == (default and #default or 0))
+    for k = 1, n do
+        assert(buf[k * 2 - 1] == default[k][1] and buf[k * 2] == default[k][2])
+    end
+end
+nav:set_search("jps")
+
+-- 分步寻路同样支持双向
+local handle = nav:new_search()
+for i = 1, 20 do
+    local q = queries[i]
+    local expect = nav:find_path(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5, "full", "bidir")
+    local status = handle:start(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5, "bidir")
+    while status == "pending" do
+        status = handle:step(3)
+    end
+    if expect then
+        local got = handle:path()
+        assert(status == "found" and #got == #expect, string.format("step query %d", i))
+    else
+        assert(status == "none")
+    end
+end
+
+-- 上限截断时退回正向一侧的部分路径
+nav:set_max_expanded(4)
+local partial = 0
+for _, q in ipairs(queries) do
+    local path, p = nav:find_path_by_grid(q[1], q[2], q[3], q[4], "full", "bidir")
+    if p then
+        partial = partial + 1
+        assert(path[1][1] == q[1] and path[1][2] == q[2])
+    end
+end
+nav:set_max_expanded(0)
+print("partial", partial)
+assert(partial > 0)
@@ -0,0 +1,181 @@
+-- 测试分层寻路: 可达性与普通寻路一致, 路径可走且接近最短, 开着分层寻路改阻挡后结果仍然正确
+local navigation = require "navigation.c"
+local test = require "test.test_api"
+local W, H = 400, 400
+local CLUSTER = 32
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+-- 同样阻挡但不开分层寻路的地图, 作为对照
+local ref = navigation.new {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+local function add_block(x, y)
+    nav:add_block(x, y)
+    ref:add_block(x, y)
+end
+
+local function clear_block(x, y)
+    nav:clear_block(x, y)
+    ref:clear_block(x, y)
+end
+
+math.randomseed(3)
+for i = 1, W * H // 6 do
+    add_block(math.random(0, W - 1), math.random(0, H - 1))
+end
+-- 几道带缺口的长墙
+for k = 1, 3 do
+    local x = k * 100
+    for y = 0, H - 1 do
+        if y % 150 ~= 75 then
+            add_block(x, y)
+        end
+    end
+end
+nav:mark_connected()
+ref:mark_connected()
+nav:set_hpa(true, CLUSTER)
+
+local queries = {}
+while #queries < 150 do
+    local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+    local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+    if not nav:is_block(x1, y1) and not nav:is_block(x2, y2) then
+        queries[#queries + 1] = {x1, y1, x2, y2}
+    end
+end
+
+-- 与 dist 相同的代价: 直走 5, 斜走 7
+local function cost(path)
+    local c = 0
+    for i = 2, #path do
+        local dx, dy = math.abs(path[i][1] - path[i - 1][1]), math.abs(path[i][2] - path[i - 1][2])
+        c = c + math.min(dx, dy) * 7 + (math.max(dx, dy) - math.min(dx, dy)) * 5
+    end
+    return c
+end
+
+-- 未平滑的格子路径: 相邻路点在同一直线或斜线上, 途经的格子都可走
+local function check_walkable(path, q)
+    assert(path[1][1] == q[1] and path[1][2] == q[2])
+    assert(path[#path][1] == q[3] and path[#path][2] == q[4])
+    for i = 2, #path do
+        local x, y = path[i - 1][1], path[i - 1][2]
+        local dx, dy = path[i][1] - x, path[i][2] - y
+        assert(dx == 0 or dy == 0 or math.abs(dx) == math.abs(dy))
+        local n = math.max(math.abs(dx), math.abs(dy))
+        local sx, sy = dx == 0 and 0 or dx // math.abs(dx), dy == 0 and 0 or dy // math.abs(dy)
+        for k = 0, n do
+            assert(not ref:is_block(x + sx * k, y + sy * k), "hpa path crosses a block")
+        end
+    end
+end
+
+local function check(tag)
+    local found, total, total_hpa, worst = 0, 0, 0, 1
+    for i, q in ipairs(queries) do
+        local expect = ref:find_path_by_grid(q[1], q[2], q[3], q[4], "none")
+        local path = nav:find_path_by_grid(q[1], q[2], q[3], q[4], "none")
+        assert((path == nil) == (expect == nil), string.format("%s query %d: reachability mismatch", tag, i))
+        if path then
+            check_walkable(path, q)
+            local a, b = cost(expect), cost(path)
+            assert(b >= a, string.format("%s query %d: shorter than optimal", tag, i))
+            -- 分层寻路只保证近似最短
+            assert(b <= a * 1.3 + 20, string.format("%s query %d: %d vs %d", tag, i, b, a))
+            found, total, total_hpa = found + 1, total + a, total_hpa + b
+            if a > 0 then
+                worst = math.max(worst, b / a)
+            end
+        end
+    end
+    assert(total_hpa <= total * 1.05, string.format("%s: %d vs %d", tag, total_hpa, total))
+    print(tag, "found", found, string.format("cost jps:%d hpa:%d worst %.2f", total, total_hpa, worst))
+end
+
+check("init")
+nav:set_open_list("fibheap")
+ref:set_open_list("fibheap")
+check("init fibheap")
+nav:set_open_list("dheap")
+ref:set_open_list("dheap")
+
+-- 分层寻路一直开着: 把墙上的缺口都堵上, 再打开新的缺口, 靠 hpa_update 作废受影响的簇
+for k = 1, 3 do
+    for y = 75, H - 1, 150 do
+        add_block(k * 100, y)
+    end
+    for y = 30, H - 1, 200 do
+        clear_block(k * 100, y)
+    end
+end
+nav:mark_connected()
+ref:mark_connected()
+check("walls")
+
+-- 零散的改动, 每轮之后都检查一次
+for round = 1, 3 do
+    for i = 1, 300 do
+        local x, y = math.random(0, W - 1), math.random(0, H - 1)
+        local q = queries[math.random(#queries)]
+        -- 不改动查询的起点终点
+        if not (x == q[1] and y == q[2]) and not (x == q[3] and y == q[4]) then
+            if math.random() < 0.5 then
+                add_block(x, y)
+            else
+                clear_block(x, y)
+            end
+        end
+    end
+    for _, q in ipairs(queries) do
+        clear_block(q[1], q[2])
+        clear_block(q[3], q[4])
+    end
+    nav:mark_connected()
+    ref:mark_connected()
+    check("round " .. round)
+end
+
+-- 连通区域按四邻域标记, 密集的阻挡里有些区域只能斜穿夹角相连,
+-- 分层寻路要和普通寻路一样按连通区域判断为不通
+local W2, H2 = 120, 120
+local dense = navigation.new {
+    w = W2,
+    h = H2,
+    obstacle = {}
+}
+local dense_ref = navigation.new {
+    w = W2,
+    h = H2,
+    obstacle = {}
+}
+math.randomseed(1)
+for i = 1, W2 * H2 // 4 do
+    local x, y = math.random(0, W2 - 1), math.random(0, H2 - 1)
+    dense:add_block(x, y)
+    dense_ref:add_block(x, y)
+end
+dense:mark_connected()
+dense_ref:mark_connected()
+dense:set_hpa(true, 8)
+local apart = 0
+for i = 1, 2000 do
+    local x1, y1 = math.random(0, W2 - 1), math.random(0, H2 - 1)
+    local x2, y2 = math.random(0, W2 - 1), math.random(0, H2 - 1)
+    if not dense:is_block(x1, y1) and not dense:is_block(x2, y2) then
+        local expect = dense_ref:find_path_by_grid(x1, y1, x2, y2, "none")
+        local path = dense:find_path_by_grid(x1, y1, x2, y2, "none")
+        assert((path == nil) == (expect == nil), string.format("dense query %d: reachability mismatch", i))
+        if dense:get_connected_id(x1, y1) ~= dense:get_connected_id(x2, y2) then
+            apart = apart + 1
+        end
+    end
+end
+print("dense", "different areas", apart)
+assert(apart > 0)
@@ -13,25 +13,40 @@ test.set_end(2498, 2499)
 for i = 1, 1000000 do
     local x = math.random(0, 4999)
     local y = math.random(0, 4999)
-    if x ~= x1 and x ~= x2 and y ~= y1 and y ~= y2 then
+    if not (x == 0 and y == 0) and not (x == 2498 and y == 2499) then
         nav:add_block(x, y)
     end
 end
 
-print("find_path")
+print("build jps+ table")
 test.calc_time(function ()
-    test.find_path()
-end, 100)
-
-print("find_path_by_grid")
-test.calc_time(function ()
-    test.find_path_by_grid()
-end, 100)
-
-print("find_path_by_grid without smooth")
-test.calc_time(function ()
-    test.find_path_by_grid(true)
-end, 100)
-
-
-
+    nav:set_jps_plus(true)
+end, 1)
+nav:set_jps_plus(false)
+
+for _, mode in ipairs {{"fibheap", false}, {"dheap", false}, {"dheap", true}} do
+    local open_list, jps_plus = mode[1], mode[2]
+    nav:set_open_list(open_list)
+    nav:set_jps_plus(jps_plus)
+    print("open list:", open_list, "jps+:", jps_plus)
+
+    print("find_path")
+    test.calc_time(function ()
+        test.find_path()
+    end, 100)
+
+    print("find_path_into")
+    test.calc_time(function ()
+        test.find_path_into()
+    end, 100)
+
+    print("find_path_by_grid")
+    test.calc_time(function ()
+        test.find_path_by_grid()
+    end, 100)
+
+    print("find_path_by_grid without smooth")
+    test.calc_time(function ()
+        test.find_path_by_grid(true)
+    end, 100)
+end
@@ -0,0 +1,91 @@
+-- 测试视线检测与逐格的精确判定一致: 坐标取 1/4 格, 经常正好穿过格点
+local navigation = require "navigation.c"
+local W, H = 30, 20
+
+-- 线段依次经过的格子: 相邻两个网格线交点之间取中点定格子, 穿过格点时四周的格子都算
+local function line_cells(x1, y1, x2, y2)
+    local cells = {}
+    local function add(x, y)
+        cells[#cells + 1] = {x, y}
+    end
+    add(math.floor(x1), math.floor(y1))
+    add(math.floor(x2), math.floor(y2))
+    local dx, dy = x2 - x1, y2 - y1
+    local ts = {0, 1}
+    for k = math.floor(math.min(x1, x2)), math.ceil(math.max(x1, x2)) do
+        if dx ~= 0 then
+            local t = (k - x1) / dx
+            if t > 0 and t < 1 then
+                ts[#ts + 1] = t
+                -- 4 倍坐标下都是整数, 可以精确判断交点是不是格点
+                local X1, Y1, DX, DY = x1 * 4, y1 * 4, dx * 4, dy * 4
+                local n = (4 * k - X1) * DY
+                if n % DX == 0 and (Y1 + n // DX) % 4 == 0 then
+                    local y = (Y1 + n // DX) // 4
+                    add(k - 1, y - 1)
+                    add(k, y - 1)
+                    add(k - 1, y)
+                    add(k, y)
+                end
+            end
+        end
+    end
+    for k = math.floor(math.min(y1, y2)), math.ceil(math.max(y1, y2)) do
+        if dy ~= 0 then
+            local t = (k - y1) / dy
+            if t > 0 and t < 1 then
+                ts[#ts + 1] = t
+            end
+        end
+    end
+    table.sort(ts)
+    for i = 2, #ts do
+        if ts[i] > ts[i - 1] then
+            local t = (ts[i] + ts[i - 1]) / 2
+            add(math.floor(x1 + dx * t), math.floor(y1 + dy * t))
+        end
+    end
+    return cells
+end
+
+math.randomseed(21)
+local total, clear = 0, 0
+for trial = 1, 20 do
+    local blocked = {}
+    local obstacle = {}
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            if math.random() < 0.15 then
+                blocked[y * W + x] = true
+                obstacle[#obstacle + 1] = {x, y}
+            end
+        end
+    end
+    local nav = navigation.new {w = W, h = H, obstacle = obstacle}
+    local function walkable(x, y)
+        return x < 0 or y < 0 or x >= W or y >= H or not blocked[y * W + x]
+    end
+    local n = 0
+    while n < 500 do
+        local x1, y1 = math.random(0, W * 4 - 1) / 4, math.random(0, H * 4 - 1) / 4
+        local x2, y2 = math.random(0, W * 4 - 1) / 4, math.random(0, H * 4 - 1) / 4
+        -- 正好沿着网格线走的线段不在约定范围内
+        local on_grid = (x1 == x2 and x1 == math.floor(x1)) or (y1 == y2 and y1 == math.floor(y1))
+        if not on_grid and walkable(math.floor(x1), math.floor(y1)) and walkable(math.floor(x2), math.floor(y2)) then
+            n = n + 1
+            local expect = true
+            for _, c in ipairs(line_cells(x1, y1, x2, y2)) do
+                if not walkable(c[1], c[2]) then
+                    expect = false
+                    break
+                end
+            end
+            local got = nav:find_line_obstacle(x1, y1, x2, y2)
+            assert(got == expect, string.format("(%s, %s) -> (%s, %s): %s ~= %s", x1, y1, x2, y2,
+                tostring(got), tostring(expect)))
+            total = total + 1
+            clear = clear + (got and 1 or 0)
+        end
+    end
+end
+print("lines", total, "clear", clear)
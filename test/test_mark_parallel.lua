@@ -0,0 +1,45 @@
+-- 测试多线程标记连通区域: 各种线程数下的区域 id 要与单线程完全一致
+local test = require "test.test_api"
+local W, H = 300, 257
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+math.randomseed(11)
+for i = 1, W * H * 2 // 5 do
+    nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+end
+-- 一条蛇形通道跨过所有条带边界
+for y = 0, H - 1, 4 do
+    for x = 0, W - 1 do
+        nav:clear_block(x, y)
+    end
+    for dy = 1, math.min(3, H - 1 - y) do
+        nav:clear_block(y % 8 == 0 and W - 1 or 0, y + dy)
+    end
+end
+
+local function snapshot()
+    local ids = {}
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            ids[#ids + 1] = nav:get_connected_id(x, y)
+        end
+    end
+    return ids
+end
+
+nav:mark_connected()
+local expect = snapshot()
+local max_id = nav:get_max_connected_id()
+for _, n in ipairs { 2, 3, 4, 8, 16, 300 } do
+    nav:mark_connected(n)
+    local ids = snapshot()
+    assert(nav:get_max_connected_id() == max_id)
+    for i = 1, #expect do
+        assert(ids[i] == expect[i], string.format("threads %d, cell %d: %d ~= %d", n, i - 1, ids[i], expect[i]))
+    end
+end
+print("areas", max_id)
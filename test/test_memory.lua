@@ -0,0 +1,118 @@
+-- 测试 memory_usage 以及连通区域 id 在 16 位存不下时自动加宽
+local test = require "test.test_api"
+local W, H = 600, 600
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+local function show(tag)
+    local usage = nav:memory_usage()
+    local total = 0
+    for _, k in ipairs { "bitmap", "transposed", "connected", "union_find", "search",
+                         "connectivity", "jump_table", "hpa", "tiles", "graph", "pool" } do
+        total = total + usage[k]
+    end
+    assert(total == usage.total)
+    print(tag, "connected", usage.connected, "search", usage.search,
+          "connectivity", usage.connectivity, "total", usage.total)
+    return usage
+end
+
+-- 还没寻路也没标记时不分配按格子的缓冲
+local usage = show("fresh")
+assert(usage.connected == W * H * 2)
+assert(usage.search < W * H)
+assert(usage.connectivity == 0)
+
+nav:find_path(1.5, 1.5, W - 1.5, H - 1.5)
+usage = show("searched")
+assert(usage.search > W * H * 8)
+
+-- 棋盘格阻挡, 每个可走格子自成一个区域, 共 W * H / 2 个
+for y = 0, H - 1 do
+    for x = (y + 1) % 2, W - 1, 2 do
+        nav:add_block(x, y)
+    end
+end
+
+local function ids()
+    local t = {}
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            t[#t + 1] = nav:get_connected_id(x, y)
+        end
+    end
+    return t
+end
+
+nav:mark_connected()
+assert(nav:get_max_connected_id() == W * H // 2)
+usage = show("wide")
+assert(usage.connected == W * H * 4)
+local expect = ids()
+assert(expect[W * H] == W * H // 2)
+
+nav:mark_connected(4)
+local got = ids()
+for i = 1, #expect do
+    assert(got[i] == expect[i], string.format("cell %d: %d ~= %d", i - 1, got[i], expect[i]))
+end
+
+-- 加宽后的快照可以原样读回
+local path = os.tmpname()
+assert(nav:save_snapshot(path))
+local c = require "navigation.c"
+local loaded = c.load(path)
+os.remove(path)
+assert(loaded:memory_usage().connected == W * H * 4)
+assert(loaded:get_connected_id(W - 1, H - 1) == expect[W * H])
+
+-- 区域变少后重新标记回到 16 位
+nav:clear_allblock()
+nav:mark_connected()
+usage = show("narrow")
+assert(usage.connected == W * H * 2)
+assert(nav:get_max_connected_id() == 1)
+
+-- 增量重标记时同时存在的区域超过 16 位才加宽
+for y = 0, H - 1 do
+    for x = 0, W - 1 do
+        nav:add_block(x, y)
+    end
+end
+nav:clear_block(0, 0)
+nav:mark_connected()
+assert(nav:get_max_connected_id() == 1)
+-- 逐个挖开棋盘格, 每个格子都分出一个新区域
+for y = 0, H - 1 do
+    for x = y % 2, W - 1, 2 do
+        if x + y > 0 then
+            nav:clear_block_and_remark(x, y)
+        end
+    end
+end
+usage = show("remark wide")
+assert(usage.connected == W * H * 4)
+assert(nav:get_max_connected_id() == W * H // 2)
+assert(nav:get_connected_id(0, 0) ~= nav:get_connected_id(2, 0))
+
+-- 反复分裂合并时标号会回收, 不会因为累计分裂次数超过 16 位而加宽
+local small = test.set_nav {
+    w = 4,
+    h = 4,
+    obstacle = {}
+}
+small:mark_connected()
+-- 每轮把左上角的格子隔开一次, 分出一个新标号
+for i = 1, 65536 do
+    small:add_block_and_remark(1, 0)
+    small:add_block_and_remark(0, 1)
+    small:clear_block_and_remark(1, 0)
+    small:clear_block_and_remark(0, 1)
+end
+assert(small:memory_usage().connected == 4 * 4 * 2)
+assert(small:get_connected_id(0, 0) == small:get_connected_id(3, 3))
+assert(small:get_max_connected_id() < 4096)
+print("small max id", small:get_max_connected_id())
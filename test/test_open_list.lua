@@ -0,0 +1,44 @@
+-- 测试开放列表: 单向跳点寻路用 fibheap 和 dheap 得到的路径代价相同, 都等于 Dijkstra 求出的最短路径
+local test = require "test.test_api"
+local W, H = 64, 48
+
+local function new_map(seed)
+    local nav = test.set_nav {
+        w = W,
+        h = H,
+        obstacle = {}
+    }
+    math.randomseed(seed)
+    for i = 1, W * H // (3 + seed % 4) do
+        nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+    end
+    return nav
+end
+
+-- fibheap 的 decrease 没有把变小的节点剪下来时, 会先弹出不是最小的节点, 路径比最短的长
+for seed = 1, 6 do
+    local nav = new_map(seed)
+    local n, found = 0, 0
+    while n < 200 do
+        local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+        local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+        if not nav:is_block(x1, y1) and not nav:is_block(x2, y2) then
+            n = n + 1
+            local optimal = test.dijkstra(nav, W, H, x1, y1)[x2 + y2 * W]
+            for _, open_list in ipairs { "fibheap", "dheap" } do
+                nav:set_open_list(open_list)
+                local path = nav:find_path_by_grid(x1, y1, x2, y2, "none")
+                assert((path == nil) == (optimal == nil), string.format("seed %d query %d", seed, n))
+                if path then
+                    local cost = test.path_cost(path)
+                    assert(cost == optimal, string.format("seed %d query %d: %s %d, optimal %d",
+                        seed, n, open_list, cost, optimal))
+                end
+            end
+            if optimal then
+                found = found + 1
+            end
+        end
+    end
+    print("seed", seed, "found", found)
+end
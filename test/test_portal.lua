@@ -49,3 +49,21 @@ assert(test_find_path({ x = 19, y = 1 }, { x = 1, y = 1 }) == test_find_path({ x
 
 assert(test_find_path({ x = 1, y = 1 }, { x = 1, y = 19 }) == test_find_path({ x = 1, y = 1 }, { x = 1, y = 19 }))
 assert(test_find_path({ x = 0, y = 0 }, { x = 19, y = 19 }) == test_find_path({ x = 0, y = 0 }, { x = 19, y = 19 }))
+
+-- 传入 out 时复用同一张表和其中的点表, 结果与不传时相同
+local out = {}
+for _, q in ipairs {
+    { { x = 1, y = 1 }, { x = 19, y = 1 } },
+    { { x = 1, y = 1 }, { x = 3, y = 18 } },
+    { { x = 19, y = 19 }, { x = 0, y = 0 } },
+    { { x = 2, y = 2 }, { x = 2.5, y = 2.5 } },
+} do
+    local expect = nav:find_path(q[1], q[2])
+    local first = out[1]
+    local got = nav:find_path(q[1], q[2], nil, nil, out)
+    assert(got == out and #got == #expect)
+    assert(first == nil or out[1] == first)
+    for i = 1, #expect do
+        assert(got[i].x == expect[i].x and got[i].y == expect[i].y)
+    end
+end
@@ -0,0 +1,137 @@
+-- 测试增量更新连通区域: 每次加减阻挡后的分区要跟全量标记的结果一致
+local test = require "test.test_api"
+local W, H = 64, 64
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+-- 增量结果和全量结果是否是同一种分区(id 可以不同, 但要一一对应)
+local function same_partition(ids)
+    local map, rmap = {}, {}
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            if not nav:is_block(x, y) then
+                local a, b = ids[y * W + x], nav:get_connected_id(x, y)
+                if (map[a] or b) ~= b or (rmap[b] or a) ~= a then
+                    return false
+                end
+                map[a], rmap[b] = b, a
+            end
+        end
+    end
+    return true
+end
+
+local function check()
+    local ids = {}
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            ids[y * W + x] = nav:get_connected_id(x, y)
+            -- 阻挡格不属于任何区域
+            assert(not nav:is_block(x, y) or ids[y * W + x] == 0)
+        end
+    end
+    nav:mark_connected()
+    assert(same_partition(ids))
+    -- 恢复增量标记的结果继续测
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            if not nav:is_block(x, y) then
+                nav:set_connected_id(x, y, ids[y * W + x])
+            end
+        end
+    end
+end
+
+math.randomseed(7)
+-- 先用竖墙把地图切开, 再随机加减阻挡
+for y = 0, H - 1 do
+    nav:add_block(W // 2, y)
+end
+nav:mark_connected()
+local splits, merges = 0, 0
+for i = 1, 3000 do
+    local x, y = math.random(0, W - 1), math.random(0, H - 1)
+    local changed
+    if math.random() < 0.6 then
+        changed = nav:add_block_and_remark(x, y)
+        if #changed > 0 then
+            splits = splits + 1
+        end
+    else
+        changed = nav:clear_block_and_remark(x, y)
+        if #changed > 1 then
+            merges = merges + 1
+        end
+    end
+    if i % 100 == 0 then
+        check()
+    end
+end
+check()
+print("splits", splits, "merges", merges, "areas", nav:get_max_connected_id())
+
+-- 手工指定的 id 必须在 0 到格子数之间
+local x, y = 0, 0
+while nav:is_block(x, y) do
+    x = x + 1
+end
+for _, id in ipairs {-5, W * H + 1, math.maxinteger, 0x7fffffff} do
+    assert(not pcall(nav.set_connected_id, nav, x, y, id))
+end
+nav:set_connected_id(x, y, W * H)
+assert(nav:get_connected_id(x, y) == W * H)
+
+-- 长时间随机改动: 不再使用的标号会被回收, 标号数不随改动次数增长, 一直是 16 位
+local SW, SH = 20, 20
+local small = test.set_nav {
+    w = SW,
+    h = SH,
+    obstacle = {}
+}
+small:mark_connected()
+local max_seen = 0
+for i = 1, 50000 do
+    local x, y = math.random(0, SW - 1), math.random(0, SH - 1)
+    if math.random() < 0.5 then
+        small:add_block_and_remark(x, y)
+    else
+        small:clear_block_and_remark(x, y)
+    end
+    max_seen = math.max(max_seen, small:get_max_connected_id())
+    if i % 5000 == 0 then
+        -- 与四邻域 flood fill 是同一种分区, 不调用 mark_connected 以免把标号重置
+        local area, rmap = {}, {}
+        for yy = 0, SH - 1 do
+            for xx = 0, SW - 1 do
+                if not small:is_block(xx, yy) and not area[yy * SW + xx] then
+                    local id = small:get_connected_id(xx, yy)
+                    assert(id > 0 and not rmap[id])
+                    rmap[id] = true
+                    local queue = {yy * SW + xx}
+                    area[yy * SW + xx] = id
+                    local k = 1
+                    while k <= #queue do
+                        local p = queue[k]
+                        k = k + 1
+                        local px, py = p % SW, p // SW
+                        for _, d in ipairs {{1, 0}, {-1, 0}, {0, 1}, {0, -1}} do
+                            local nx, ny = px + d[1], py + d[2]
+                            if nx >= 0 and nx < SW and ny >= 0 and ny < SH and not small:is_block(nx, ny)
+                                    and not area[ny * SW + nx] then
+                                assert(small:get_connected_id(nx, ny) == id)
+                                area[ny * SW + nx] = id
+                                queue[#queue + 1] = ny * SW + nx
+                            end
+                        end
+                    end
+                end
+            end
+        end
+    end
+end
+print("small map max label", max_seen)
+assert(max_seen < 4096)
+assert(small:memory_usage().connected == SW * SH * 2)
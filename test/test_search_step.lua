@@ -0,0 +1,174 @@
+-- 测试分步寻路句柄和展开节点数上限: 分步的结果与一次寻路相同, 超过上限时返回部分路径
+local navigation = require "navigation.c"
+local W, H = 200, 150
+
+local function new_nav()
+    local nav = navigation.new {w = W, h = H, obstacle = {}}
+    math.randomseed(24)
+    for i = 1, W * H // 6 do
+        nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+    end
+    -- 几道只在一端留口的墙, 让路径来回绕
+    for x = 20, W - 20, 30 do
+        local gap = (x // 30) % 2 == 0 and 3 or H - 4
+        for y = 0, H - 1 do
+            if math.abs(y - gap) > 2 then
+                nav:add_block(x, y)
+            end
+        end
+    end
+    nav:mark_connected()
+    return nav
+end
+
+local nav = new_nav()
+
+local function same(a, b)
+    if #a ~= #b then
+        return false
+    end
+    for i = 1, #a do
+        if a[i][1] ~= b[i][1] or a[i][2] ~= b[i][2] then
+            return false
+        end
+    end
+    return true
+end
+
+local function h(x1, y1, x2, y2)
+    local dx, dy = math.abs(x1 - x2), math.abs(y1 - y2)
+    return math.max(dx, dy) * 5 + math.min(dx, dy) * 2
+end
+
+local queries = {}
+while #queries < 60 do
+    local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+    local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+    if not nav:is_block(x1, y1) and not nav:is_block(x2, y2)
+        and nav:get_connected_id(x1, y1) == nav:get_connected_id(x2, y2) then
+        queries[#queries + 1] = {x1 + 0.5, y1 + 0.5, x2 + 0.5, y2 + 0.5}
+    end
+end
+
+local function check_steps(tag)
+    local handle = nav:new_search()
+    local steps, partials = 0, 0
+    for i, q in ipairs(queries) do
+        local expect = nav:find_path(q[1], q[2], q[3], q[4])
+        local status = handle:start(q[1], q[2], q[3], q[4])
+        while status == "pending" do
+            status = handle:step(7)
+            steps = steps + 1
+            -- 中途取部分路径不影响继续搜索
+            if status == "pending" and steps % 5 == 0 then
+                local part, partial = handle:path()
+                if part then
+                    assert(partial)
+                    partials = partials + 1
+                end
+            end
+        end
+        assert(status == "found", string.format("%s query %d: %s", tag, i, status))
+        local got, partial = handle:path()
+        assert(not partial and same(got, expect), string.format("%s query %d", tag, i))
+        -- 按时间分片
+        handle:start(q[1], q[2], q[3], q[4])
+        status = handle:step(0, 50)
+        while status == "pending" do
+            status = handle:step(0, 50)
+        end
+        assert(status == "found" and same(handle:path(), expect))
+    end
+    print(tag, "steps", steps, "partial paths", partials)
+end
+
+check_steps("jps")
+nav:set_open_list("dheap")
+check_steps("jps dheap")
+nav:set_search("theta")
+check_steps("theta dheap")
+nav:set_open_list("fibheap")
+check_steps("theta")
+nav:set_search("jps")
+
+-- 展开节点数上限: 返回的部分路径终点比起点更接近终点
+local found, partial_count = 0, 0
+for _, q in ipairs(queries) do
+    local full = nav:find_path(q[1], q[2], q[3], q[4])
+    nav:set_max_expanded(10)
+    local path, partial = nav:find_path(q[1], q[2], q[3], q[4])
+    local grid, grid_partial = nav:find_path_by_grid(q[1] // 1, q[2] // 1, q[3] // 1, q[4] // 1)
+    nav:set_max_expanded(0)
+    if partial then
+        partial_count = partial_count + 1
+        assert(grid_partial)
+        local last = path[#path]
+        assert(last[1] % 1 == 0.5 and last[2] % 1 == 0.5)
+        assert(not nav:is_block(last[1] // 1, last[2] // 1))
+        assert(h(last[1], last[2], q[3], q[4]) < h(q[1], q[2], q[3], q[4]))
+        assert(path[1][1] == q[1] and path[1][2] == q[2])
+        local g = grid[#grid]
+        assert(g[1] == last[1] // 1 and g[2] == last[2] // 1)
+    elseif path then
+        found = found + 1
+        assert(same(path, full))
+    end
+end
+print("capped", "partial", partial_count, "found", found)
+assert(partial_count > 0)
+
+-- find_path_into 和批量寻路同样标出部分路径, 线程池里也一样
+local function check_capped_batch()
+    local batch = {}
+    for i, q in ipairs(queries) do
+        batch[i] = q
+    end
+    nav:set_max_expanded(10)
+    local buf = {}
+    local expect = {}
+    for i, q in ipairs(queries) do
+        local _, partial = nav:find_path(q[1], q[2], q[3], q[4])
+        local n, into_partial = nav:find_path_into(buf, q[1], q[2], q[3], q[4])
+        assert(n > 0 and partial == into_partial, string.format("into query %d", i))
+        expect[i] = partial
+    end
+    local paths, partial = nav:find_paths(batch)
+    nav:set_max_expanded(0)
+    assert(partial)
+    for i = 1, #queries do
+        assert(paths[i] and partial[i] == expect[i], string.format("batch query %d", i))
+    end
+    local _, none = nav:find_paths(batch)
+    assert(none == nil)
+end
+check_capped_batch()
+nav:set_threads(2)
+check_capped_batch()
+nav:set_threads(0)
+
+-- 不连通和同一格
+local handle = nav:new_search()
+local bx, by
+for y = 0, H - 1 do
+    for x = 0, W - 1 do
+        if nav:is_block(x, y) then
+            bx, by = x, y
+        end
+    end
+end
+local q = queries[1]
+assert(handle:start(q[1], q[2], bx + 0.5, by + 0.5) == "none")
+assert(handle:path() == nil)
+assert(handle:start(q[1], q[2], q[1] + 0.2, q[2] + 0.2) == "found")
+assert(#handle:path() == 2)
+
+-- 句柄引用着地图, 地图对象本身不再被引用时也不会被回收
+local orphan = new_nav():new_search()
+collectgarbage()
+collectgarbage()
+local status = orphan:start(q[1], q[2], q[3], q[4])
+while status == "pending" do
+    status = orphan:step(100)
+end
+assert(status == "found")
+print("orphan expanded", orphan:expanded())
@@ -0,0 +1,61 @@
+-- 测试连接点之间的路径缓存: 中间区域的阻挡变化后, 穿过它的路径要重新计算
+local navigation = require "navigation"
+local w = 30
+local h = 20
+local nav = navigation.new(w, h, {})
+
+for y = 0, h - 1 do
+    nav:set_obstacle { x = 10, y = y }
+    nav:set_obstacle { x = 20, y = y }
+end
+nav:update_areas()
+nav:add_portal({ x = 10, y = 3 })
+nav:add_portal({ x = 20, y = 16 })
+
+local function test_find_path(pos1, pos2)
+    print("========================")
+    print(string.format("find path (%s, %s) => (%s, %s)", pos1.x, pos1.y, pos2.x, pos2.y))
+    local ret = nav:find_path(pos1, pos2)
+    for _, v in ipairs(ret) do
+        print(v.x, v.y)
+        assert(not nav:is_obstacle(v))
+    end
+    print("========================")
+    return ret
+end
+
+local from, to = { x = 2.5, y = 10.5 }, { x = 28.5, y = 10.5 }
+local direct = test_find_path(from, to)
+
+-- 中间区域横一道墙, 只在右侧留缺口
+for x = 11, 18 do
+    nav:set_obstacle { x = x, y = 10 }
+end
+local detour = test_find_path(from, to)
+assert(#detour > #direct)
+
+for x = 11, 18 do
+    nav:unset_obstacle { x = x, y = 10 }
+end
+assert(#test_find_path(from, to) == #direct)
+
+-- 忽略列表临时清掉的阻挡不能留在缓存的路径里
+local function path_length(path)
+    local len = 0
+    for i = 2, #path do
+        len = len + math.sqrt((path[i].x - path[i - 1].x) ^ 2 + (path[i].y - path[i - 1].y) ^ 2)
+    end
+    return len
+end
+
+local wall = {}
+for x = 11, 18 do
+    nav:set_obstacle { x = x, y = 10 }
+    wall[#wall + 1] = { x = x, y = 10 }
+end
+local ignored = nav:find_path(from, to, nil, wall)
+assert(path_length(ignored) < path_length(detour) - 1)
+for _, pos in ipairs(wall) do
+    assert(nav:is_obstacle(pos))
+end
+assert(math.abs(path_length(test_find_path(from, to)) - path_length(detour)) < 1e-6)
@@ -0,0 +1,98 @@
+-- 测试网格共享: attach 得到的地图与原图一致, 任何一方修改都只影响自己
+local navigation = require "navigation.c"
+local W, H = 120, 100
+local nav = navigation.new { w = W, h = H, obstacle = {} }
+
+math.randomseed(13)
+for i = 1, W * H // 4 do
+    nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+end
+nav:mark_connected()
+nav:set_jps_plus(true)
+
+-- 正常使用时 share 的结果传给另一个 lua_State 再 attach, 这里在同一个 State 里模拟
+local other = navigation.attach(nav:share())
+local third = navigation.attach(nav:share())
+
+local function same_map(a, b)
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            if a:is_block(x, y) ~= b:is_block(x, y) or a:get_connected_id(x, y) ~= b:get_connected_id(x, y) then
+                return false
+            end
+        end
+    end
+    return true
+end
+
+local function same_paths(a, b)
+    math.randomseed(17)
+    for i = 1, 100 do
+        local x1, y1 = math.random(0, W - 1) + 0.5, math.random(0, H - 1) + 0.5
+        local x2, y2 = math.random(0, W - 1) + 0.5, math.random(0, H - 1) + 0.5
+        local p1, p2 = a:find_path(x1, y1, x2, y2) or {}, b:find_path(x1, y1, x2, y2) or {}
+        if #p1 ~= #p2 then
+            return false
+        end
+        for k = 1, #p1 do
+            if p1[k][1] ~= p2[k][1] or p1[k][2] ~= p2[k][2] then
+                return false
+            end
+        end
+    end
+    return true
+end
+
+assert(same_map(nav, other))
+assert(same_paths(nav, other))
+
+-- other 改动后复制出自己的一份, nav 和 third 仍然共享原来的网格
+local row = {}
+for x = 0, W - 1 do
+    row[x] = nav:is_block(x, H // 2)
+    other:add_block_and_remark(x, H // 2)
+end
+for x = 0, W - 1 do
+    assert(nav:is_block(x, H // 2) == row[x])
+    assert(other:is_block(x, H // 2))
+end
+assert(same_map(nav, third))
+assert(not same_map(nav, other))
+
+-- nav 关掉跳点表不影响还在共享的 third
+nav:set_jps_plus(false)
+assert(same_paths(nav, third))
+nav:clear_allblock()
+assert(not nav:is_block(0, 0) and third:is_block(W // 2, H // 2) == row[W // 2])
+third:set_jps_plus(false)
+third:set_jps_plus(true)
+
+-- 共享期间关掉跳点表, 另一方被回收后原地修改阻挡, 再 share 出去的不能是过期的表
+local owner = navigation.new { w = W, h = H, obstacle = {} }
+owner:set_jps_plus(true)
+local holder = navigation.attach(owner:share())
+owner:set_jps_plus(false)
+holder = nil
+collectgarbage()
+collectgarbage()
+for x = 0, W - 2 do
+    owner:add_block(x, H // 3)
+end
+local late = navigation.attach(owner:share())
+assert(same_paths(owner, late))
+late:set_jps_plus(true)
+assert(same_paths(owner, late))
+
+-- 同一个 share 只能 attach 一次
+local share = owner:share()
+local once = navigation.attach(share)
+assert(not pcall(navigation.attach, share))
+
+-- 阻挡状态没变的修改不会复制共享的网格
+assert(once:memory_usage().shared)
+once:add_block(0, H // 3)
+once:clear_block(W - 1, H // 3)
+assert(once:memory_usage().shared and owner:memory_usage().shared)
+once:add_block(W - 1, H // 3)
+assert(not once:memory_usage().shared)
+print("share ok")
@@ -14,6 +14,12 @@ nav:dump()
 test.set_start(0.1, 10.6)
 test.set_end(15.6, 15.2)
 test.print_find_path()
+test.print_find_path_into()
+test.print_find_paths {
+    {0.1, 10.6, 15.6, 15.2},
+    {15.6, 15.2, 0.1, 10.6},
+    {0.1, 10.6, 4.5, 10.5}, -- 终点在阻挡里
+}
 
 test.set_start(0, 10)
 test.set_end(15, 15)
@@ -0,0 +1,87 @@
+-- 测试单遍贪心平滑: 结果是原路点的子序列, 相邻路点互相可见, 总长不超过原路径
+local test = require "test.test_api"
+local W, H = 120, 80
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+math.randomseed(22)
+for i = 1, W * H // 6 do
+    nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+end
+-- 几道带缺口的墙, 让路径出现长的之字形
+for x = 10, W - 10, 20 do
+    for y = 0, H - 1 do
+        if y % 40 ~= 5 then
+            nav:add_block(x, y)
+        end
+    end
+end
+nav:mark_connected()
+
+local function length(path)
+    local len = 0
+    for i = 2, #path do
+        local dx, dy = path[i][1] - path[i - 1][1], path[i][2] - path[i - 1][2]
+        len = len + math.sqrt(dx * dx + dy * dy)
+    end
+    return len
+end
+
+local function visible(a, b)
+    return nav:find_line_obstacle(a[1] + 0.5, a[2] + 0.5, b[1] + 0.5, b[2] + 0.5)
+end
+
+local found, raw_len, full_len, linear_len, raw_points, full_points, linear_points = 0, 0, 0, 0, 0, 0, 0
+for i = 1, 300 do
+    local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+    local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+    if nav:is_block(x1, y1) or nav:is_block(x2, y2) then
+        goto continue
+    end
+    local raw = nav:find_path_by_grid(x1, y1, x2, y2, true)
+    if not raw then
+        goto continue
+    end
+    local none = nav:find_path_by_grid(x1, y1, x2, y2, "none")
+    local full = nav:find_path_by_grid(x1, y1, x2, y2)
+    assert(#nav:find_path_by_grid(x1, y1, x2, y2, "full") == #full)
+    local linear = nav:find_path_by_grid(x1, y1, x2, y2, "linear")
+    assert(#none == #raw)
+    -- 子序列, 首尾不变
+    local k = 1
+    for _, p in ipairs(linear) do
+        while k <= #raw and (raw[k][1] ~= p[1] or raw[k][2] ~= p[2]) do
+            k = k + 1
+        end
+        assert(k <= #raw, string.format("query %d: (%d, %d) not on raw path", i, p[1], p[2]))
+    end
+    assert(linear[1][1] == raw[1][1] and linear[1][2] == raw[1][2])
+    assert(linear[#linear][1] == raw[#raw][1] and linear[#linear][2] == raw[#raw][2])
+    -- 合并过的相邻路点之间必须可见
+    for j = 2, #linear do
+        local a, b = linear[j - 1], linear[j]
+        local adjacent = false
+        for r = 2, #raw do
+            if raw[r - 1][1] == a[1] and raw[r - 1][2] == a[2] and raw[r][1] == b[1] and raw[r][2] == b[2] then
+                adjacent = true
+                break
+            end
+        end
+        assert(adjacent or visible(a, b), string.format("query %d: segment %d blocked", i, j))
+    end
+    assert(length(linear) <= length(raw) + 1e-6)
+    found = found + 1
+    raw_len, full_len, linear_len = raw_len + length(raw), full_len + length(full), linear_len + length(linear)
+    raw_points, full_points, linear_points = raw_points + #raw, full_points + #full, linear_points + #linear
+    -- 浮点版本同样可选, 首尾两段可能再插入拐点
+    local fpath = nav:find_path(x1 + 0.5, y1 + 0.5, x2 + 0.5, y2 + 0.5, "linear")
+    assert(#fpath >= math.min(#linear, 2))
+    ::continue::
+end
+print("found", found)
+print(string.format("raw    points %d length %.1f", raw_points, raw_len))
+print(string.format("full   points %d length %.1f", full_points, full_len))
+print(string.format("linear points %d length %.1f", linear_points, linear_len))
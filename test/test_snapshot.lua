@@ -0,0 +1,108 @@
+-- 测试地图快照: 加载后的阻挡、区域 id、寻路结果与原图一致, 修改加载的地图不影响文件
+local navigation = require "navigation.c"
+local W, H = 200, 150
+local nav = navigation.new { w = W, h = H, obstacle = {} }
+
+math.randomseed(5)
+for i = 1, W * H // 4 do
+    nav:add_block(math.random(0, W - 1), math.random(0, H - 1))
+end
+nav:mark_connected()
+nav:set_jps_plus(true)
+
+local path = os.tmpname()
+assert(nav:save_snapshot(path))
+
+local function same_map(a, b)
+    for y = 0, H - 1 do
+        for x = 0, W - 1 do
+            if a:is_block(x, y) ~= b:is_block(x, y) or a:get_connected_id(x, y) ~= b:get_connected_id(x, y) then
+                return false
+            end
+        end
+    end
+    return a:get_max_connected_id() == b:get_max_connected_id()
+end
+
+local function same_paths(a, b)
+    math.randomseed(9)
+    for i = 1, 100 do
+        local x1, y1 = math.random(0, W - 1) + 0.5, math.random(0, H - 1) + 0.5
+        local x2, y2 = math.random(0, W - 1) + 0.5, math.random(0, H - 1) + 0.5
+        local p1, p2 = a:find_path(x1, y1, x2, y2) or {}, b:find_path(x1, y1, x2, y2) or {}
+        if #p1 ~= #p2 then
+            return false
+        end
+        for k = 1, #p1 do
+            if p1[k][1] ~= p2[k][1] or p1[k][2] ~= p2[k][2] then
+                return false
+            end
+        end
+    end
+    return true
+end
+
+local loaded = assert(navigation.load(path))
+assert(same_map(nav, loaded))
+assert(same_paths(nav, loaded))
+
+-- 加载后照常修改, 跳点表和连通区域都跟着更新
+local row = {}
+for x = 0, W - 1 do
+    row[x] = nav:is_block(x, H // 2)
+end
+for x = 0, W - 1 do
+    loaded:add_block_and_remark(x, H // 2)
+    nav:add_block_and_remark(x, H // 2)
+end
+assert(same_map(nav, loaded))
+assert(same_paths(nav, loaded))
+
+-- 文件本身没有被改动
+local again = assert(navigation.load(path))
+for x = 0, W - 1 do
+    assert(again:is_block(x, H // 2) == row[x])
+end
+
+local bad = os.tmpname()
+local f = io.open(bad, "wb")
+f:write("not a snapshot at all, just some bytes to fill the header size.........")
+f:close()
+local ok, err = navigation.load(bad)
+assert(ok == nil and err)
+print("load bad file:", err)
+
+-- 文件内容不可信, 改坏文件头或数据后都要拒绝加载, 不能越界
+f = io.open(path, "rb")
+local data = f:read("a")
+f:close()
+local bitmap_offset, tm_offset, connected_offset, jump_offset = string.unpack("<I8I8I8I8", data, 41)
+
+local function patch(pos, fmt, ...)
+    local v = string.pack(fmt, ...)
+    return data:sub(1, pos - 1) .. v .. data:sub(pos + #v)
+end
+
+local function load_bad(content)
+    f = io.open(bad, "wb")
+    f:write(content)
+    f:close()
+    local ok, err = navigation.load(bad)
+    assert(ok == nil and err)
+    print("load bad file:", err)
+    return err
+end
+
+-- 宽高相乘超出 int
+assert(load_bad(patch(17, "<i4i4", 65536, 65536)) == "bad snapshot size")
+-- 区域 id 超过文件头里的最大 id
+assert(load_bad(patch(29, "<i4", 1)) == "bad snapshot connected id")
+-- 边框上的阻挡被清掉
+assert(load_bad(patch(bitmap_offset + 1, "B", 0)) == "bad snapshot border")
+assert(load_bad(patch(tm_offset + 1, "B", 0)) == "bad snapshot border")
+-- 最后一格向右下的跳点表项跳出地图
+assert(load_bad(patch(jump_offset + W * H * 8 - 8 + 3 + 1, "b", 5)) == "bad snapshot jump table")
+-- 偏移加长度溢出
+assert(load_bad(patch(57, "<I8", -2)) == "truncated snapshot")
+os.remove(bad)
+os.remove(path)
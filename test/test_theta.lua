@@ -0,0 +1,96 @@
+-- 测试任意角度寻路: 相邻拐点互相可见, 总长不超过跳点寻路加平滑, 两种开放列表结果接近
+local test = require "test.test_api"
+local W, H = 160, 120
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+-- 成团的阻挡和带缺口的墙. 跳点寻路允许斜穿两个阻挡的夹角, 任意角度寻路不允许,
+-- 零散阻挡很多的地图上后者反而可能更长, 这里不比较
+math.randomseed(23)
+for i = 1, 30 do
+    local x, y = math.random(0, W - 1), math.random(0, H - 1)
+    for yy = math.max(0, y - 4), math.min(H - 1, y + 4) do
+        for xx = math.max(0, x - 6), math.min(W - 1, x + 6) do
+            nav:add_block(xx, yy)
+        end
+    end
+end
+for y = 0, H - 1 do
+    if y % 30 ~= 7 then
+        nav:add_block(80, y)
+    end
+end
+nav:mark_connected()
+
+local function length(path)
+    local len = 0
+    for i = 2, #path do
+        local dx, dy = path[i][1] - path[i - 1][1], path[i][2] - path[i - 1][2]
+        len = len + math.sqrt(dx * dx + dy * dy)
+    end
+    return len
+end
+
+local queries = {}
+while #queries < 200 do
+    local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+    local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+    if not nav:is_block(x1, y1) and not nav:is_block(x2, y2) then
+        queries[#queries + 1] = {x1, y1, x2, y2}
+    end
+end
+
+local found, jps_len, theta_len, shorter = 0, 0, 0, 0
+for i, q in ipairs(queries) do
+    nav:set_search("jps")
+    local jps = nav:find_path_by_grid(q[1], q[2], q[3], q[4])
+    nav:set_search("theta")
+    local theta = nav:find_path_by_grid(q[1], q[2], q[3], q[4])
+    -- 连通区域是 4 连通的, 同一区域内任意角度寻路也一定找得到
+    assert((jps == nil) == (theta == nil), string.format("query %d", i))
+    if theta then
+        assert(theta[1][1] == q[1] and theta[1][2] == q[2])
+        assert(theta[#theta][1] == q[3] and theta[#theta][2] == q[4])
+        for j = 2, #theta do
+            local a, b = theta[j - 1], theta[j]
+            assert(nav:find_line_obstacle(a[1] + 0.5, a[2] + 0.5, b[1] + 0.5, b[2] + 0.5),
+                string.format("query %d: segment %d blocked", i, j))
+        end
+        nav:set_open_list("dheap")
+        local other = nav:find_path_by_grid(q[1], q[2], q[3], q[4])
+        nav:set_open_list("fibheap")
+        -- 出队顺序不同, Lazy Theta* 的结果可能略有差别
+        assert(math.abs(length(other) - length(theta)) < length(theta) * 0.01, string.format("query %d", i))
+        local a, b = length(jps), length(theta)
+        found = found + 1
+        jps_len, theta_len = jps_len + a, theta_len + b
+        if b < a - 1e-6 then
+            shorter = shorter + 1
+        end
+        -- 浮点路径直接用拐点, 不再平滑
+        local fpath = nav:find_path(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5)
+        assert(#fpath >= math.min(#theta, 2))
+    end
+end
+print("found", found, "shorter", shorter)
+print(string.format("jps+smooth length %.1f theta length %.1f", jps_len, theta_len))
+-- 任意角度路径总体不应比平滑后的跳点路径长
+assert(theta_len <= jps_len)
+
+-- 线程池里的上下文跟随主上下文的设置
+local batch = {}
+for i = 1, 20 do
+    local q = queries[i]
+    batch[i] = {q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5}
+end
+local expect = nav:find_paths(batch)
+nav:set_threads(2)
+local got = nav:find_paths(batch)
+nav:set_threads(0)
+for i = 1, #batch do
+    assert((expect[i] and #expect[i]) == (got[i] and #got[i]), string.format("batch %d", i))
+end
+nav:set_search("jps")
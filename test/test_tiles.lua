@@ -0,0 +1,113 @@
+-- 测试分块统计: 开启后寻路和视线检测的结果与逐格检查完全一致, 改阻挡后仍然一致
+local test = require "test.test_api"
+local W, H = 500, 300
+local nav = test.set_nav {
+    w = W,
+    h = H,
+    obstacle = {}
+}
+
+math.randomseed(7)
+-- 大片空地上成团的阻挡, 有的正好压在分块边界上
+for i = 1, 40 do
+    local x, y = math.random(0, W - 1), math.random(0, H - 1)
+    local r = math.random(1, 10)
+    for yy = math.max(0, y - r), math.min(H - 1, y + r) do
+        for xx = math.max(0, x - r), math.min(W - 1, x + r // 2) do
+            nav:add_block(xx, yy)
+        end
+    end
+end
+for y = 0, H - 1 do
+    if y % 100 ~= 50 then
+        nav:add_block(128, y)
+        nav:add_block(255, y)
+    end
+end
+-- 一整块全是阻挡
+for y = 192, 255 do
+    for x = 320, 383 do
+        nav:add_block(x, y)
+    end
+end
+nav:mark_connected()
+
+local queries = {}
+while #queries < 200 do
+    local x1, y1 = math.random(0, W - 1), math.random(0, H - 1)
+    local x2, y2 = math.random(0, W - 1), math.random(0, H - 1)
+    if not nav:is_block(x1, y1) and not nav:is_block(x2, y2) then
+        queries[#queries + 1] = {x1, y1, x2, y2}
+    end
+end
+
+local function run()
+    local ret = {}
+    for i, q in ipairs(queries) do
+        if nav:is_block(q[1], q[2]) or nav:is_block(q[3], q[4]) then
+            ret[i] = "blocked"
+            goto continue
+        end
+        local raw = nav:find_path_by_grid(q[1], q[2], q[3], q[4], true) or {}
+        local smooth = nav:find_path(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5) or {}
+        local los = nav:find_line_obstacle(q[1] + 0.5, q[2] + 0.5, q[3] + 0.5, q[4] + 0.5)
+        local t = {tostring(los)}
+        for _, p in ipairs(raw) do
+            t[#t + 1] = p[1] .. "," .. p[2]
+        end
+        t[#t + 1] = "|"
+        for _, p in ipairs(smooth) do
+            t[#t + 1] = string.format("%.3f,%.3f", p[1], p[2])
+        end
+        ret[i] = table.concat(t, " ")
+        ::continue::
+    end
+    return ret
+end
+
+local function check(tag)
+    nav:set_tiles(false)
+    local expect = run()
+    nav:set_tiles(true)
+    local got = run()
+    local found = 0
+    for i = 1, #expect do
+        assert(got[i] == expect[i], string.format("%s query %d:\n%s\n%s", tag, i, expect[i], got[i]))
+        if #expect[i] > 10 then
+            found = found + 1
+        end
+    end
+    print(tag, "queries", #queries, "found", found)
+end
+
+check("static")
+
+-- 分块开启时增量改阻挡, 统计要跟着变
+nav:set_tiles(true)
+for i = 1, 3000 do
+    local x, y = math.random(0, W - 1), math.random(0, H - 1)
+    if i % 3 == 0 then
+        nav:clear_block(x, y)
+    else
+        nav:add_block(x, y)
+    end
+end
+for y = 192, 255 do
+    for x = 320, 383 do
+        nav:clear_block(x, y)
+    end
+end
+nav:mark_connected()
+local expect = run()
+nav:set_tiles(false)
+nav:set_tiles(true)
+local got = run()
+for i = 1, #expect do
+    assert(got[i] == expect[i], string.format("incremental query %d", i))
+end
+check("dynamic")
+
+nav:clear_allblock()
+nav:mark_connected()
+check("empty")
+print("tiles memory", nav:memory_usage().tiles)
@@ -0,0 +1,167 @@
+#include <math.h>
+
+#include "connected.h"
+#include "openset.h"
+#include "smooth.h"
+#include "theta.h"
+
+static inline int compare(struct node_data* old, struct node_data* new) {
+    if (new->f_value < old->f_value) {
+        return 1;
+    } else {
+        return -1;
+    }
+}
+
+static inline int euclid(Map* m, int a, int b) {
+    int dx = a % m->width - b % m->width;
+    int dy = a / m->width - b / m->width;
+    return (int)(sqrt((double)(dx * dx + dy * dy)) * THETA_UNIT + 0.5);
+}
+
+static inline int visible(Map* m, int a, int b) {
+    int ax, ay, bx, by;
+    pos2xy(m, a, &ax, &ay);
+    pos2xy(m, b, &bx, &by);
+    return find_line_obstacle(m, ax + 0.5, ay + 0.5, bx + 0.5, by + 0.5) < 0;
+}
+
+// 从 bit 可以直接走过去的方向, 斜向要求两侧的直线邻居都可走
+static unsigned char walkable_dirs(Map* m, int bit) {
+    unsigned char dirs = EMPTY_DIRECTIONSET;
+    unsigned char d;
+    for (d = 0; d < 8; d += 2) {
+        if (!BITTEST(m->m, bit + m->bit_offset[d])) {
+            dir_add(&dirs, d);
+        }
+    }
+    for (d = 1; d < 8; d += 2) {
+        if ((dirs & (1 << (d - 1))) && (dirs & (1 << ((d + 1) % 8)))
+            && !BITTEST(m->m, bit + m->bit_offset[d])) {
+            dir_add(&dirs, d);
+        }
+    }
+    return dirs;
+}
+
+static struct node_data* construct(Map* m, SearchContext* s, int pos, int g_value) {
+    struct node_data* node = (struct node_data*)arena_alloc(&s->arena, sizeof(struct node_data));
+    node->pos = pos;
+    node->g_value = g_value;
+    node->f_value = g_value + euclid(m, pos, s->end);
+    node->dir = NO_DIRECTION;
+    return node;
+}
+
+int theta_start(Map* m, SearchContext* s) {
+    int len = m->width * m->height;
+    search_ctx_prepare(s);
+    search_ctx_prepare_cell_g(s);
+    s->search_gen += 2;
+    if (s->search_gen >= UINT_MAX - 1) {
+        memset(s->gen, 0, len * sizeof(unsigned int));
+        s->search_gen = 2;
+    }
+    s->expanded = 0;
+    s->closest = s->start;
+    s->closest_h = euclid(m, s->start, s->end);
+    touch(s, s->start);
+    if (s->start == s->end) {
+        return s->end;
+    }
+    if (m->mark_connected && (map_connected_id(m, s->start) != map_connected_id(m, s->end))) {
+        return SEARCH_NONE;
+    }
+    arena_reset(&s->arena);
+    s->open_set = NULL;
+    if (s->open_list == OPEN_LIST_DHEAP) {
+        dheap_reset(&s->open_heap, (int*)s->open_set_map, compare);
+    } else {
+        s->open_set = fibheap_init(&s->arena, len, compare);
+    }
+    s->cell_g[s->start] = 0;
+    open_set_push(s->open_set, s, construct(m, s, s->start, 0));
+    return SEARCH_PENDING;
+}
+
+int theta_step(Map* m, SearchContext* s, int n) {
+    int w = m->width;
+    const int step[8] = {-w, 1 - w, 1, 1 + w, w, w - 1, -1, -1 - w};
+    struct heap* open_set = s->open_set;
+    int* g = s->cell_g;
+    struct node_data* node;
+    for (; n > 0; n--) {
+        if (!(node = open_set_pop(open_set, s))) {
+            return SEARCH_NONE;
+        }
+        int pos = node->pos;
+        int bit = pos2bit(m, pos);
+        unsigned char dirs = walkable_dirs(m, bit);
+        unsigned char d;
+        s->gen[pos] = s->search_gen + 1;
+        s->expanded++;
+
+        int parent = s->comefrom[pos];
+        if (parent >= 0 && !visible(m, parent, pos)) {
+            // 父节点看不见, 改从相邻的已关闭格子过来, 扩展它的节点一定在其中
+            int best = INT_MAX;
+            for (d = 0; d < 8; d++) {
+                int nb = pos + step[d];
+                if ((dirs & (1 << d)) && s->gen[nb] == s->search_gen + 1) {
+                    int ng = g[nb] + euclid(m, nb, pos);
+                    if (ng < best) {
+                        best = ng;
+                        parent = nb;
+                    }
+                }
+            }
+            s->comefrom[pos] = parent;
+            g[pos] = best;
+        }
+        if (pos == s->end) {
+            return pos;
+        }
+        if (node->f_value - node->g_value < s->closest_h) {
+            s->closest = pos;
+            s->closest_h = node->f_value - node->g_value;
+        }
+
+        // 先假定父节点能看到邻居, 父节点不存在时就是起点自己
+        int from = parent >= 0 ? parent : pos;
+        for (d = 0; d < 8; d++) {
+            if (!(dirs & (1 << d))) {
+                continue;
+            }
+            int nb = pos + step[d];
+            unsigned int gen = s->gen[nb];
+            if (gen == s->search_gen + 1) {
+                continue;
+            }
+            if (gen != s->search_gen) {
+                touch(s, nb);
+            }
+            int ng = g[from] + euclid(m, from, nb);
+            struct node_data* p = open_set_find(s, nb);
+            if (!p) {
+                s->comefrom[nb] = from;
+                g[nb] = ng;
+                open_set_push(open_set, s, construct(m, s, nb, ng));
+            } else if (ng < p->g_value) {
+                s->comefrom[nb] = from;
+                g[nb] = ng;
+                p->f_value -= p->g_value - ng;
+                p->g_value = ng;
+                open_set_decrease(open_set, s, p);
+            }
+        }
+    }
+    return SEARCH_PENDING;
+}
+
+int theta_find_path(Map* m, SearchContext* s) {
+    int ret = theta_start(m, s);
+    if (ret == SEARCH_PENDING) {
+        ret = theta_step(m, s, s->max_expanded > 0 ? s->max_expanded : INT_MAX);
+    }
+    return ret;
+}
@@ -0,0 +1,20 @@
+#ifndef __THETA_H__
+#define __THETA_H__ 0
+
+#include "map.h"
+
+/*
+    Lazy Theta* 任意角度寻路: 在 8 连通网格上做 A*, 扩展邻居时先假定当前节点的父节点能直接看到邻居,
+    等邻居出队时才用 find_line_obstacle 验证, 看不见就改挂到相邻的已关闭格子中 g 最小的一个.
+    斜向移动要求两侧的直线邻居都可走, 与视线检测穿过格点时的规则一致.
+    结果写在 comefrom 里, 父子节点之间都是直线可达, 不需要再平滑
+*/
+
+#define THETA_UNIT 1024 // g 值以 1/THETA_UNIT 格为单位
+
+// 返回值和分步用法同 jps_find_path / jps_start / jps_step
+int theta_find_path(Map* m, SearchContext* s);
+int theta_start(Map* m, SearchContext* s);
+int theta_step(Map* m, SearchContext* s, int n);
+
+#endif /* __THETA_H__ */
@@ -0,0 +1,106 @@
+#include "tile.h"
+
+// 重算第 ty 行块的左右连续空块数
+static void refresh_row_runs(struct tiles* t, int ty) {
+    const unsigned short* nblock = t->nblock + ty * t->tw;
+    unsigned short* right = t->run[0] + ty * t->tw;
+    unsigned short* left = t->run[1] + ty * t->tw;
+    int tx;
+    for (tx = t->tw - 1; tx >= 0; tx--) {
+        right[tx] = nblock[tx] == 0 ? (tx + 1 < t->tw ? right[tx + 1] : 0) + 1 : 0;
+    }
+    for (tx = 0; tx < t->tw; tx++) {
+        left[tx] = nblock[tx] == 0 ? (tx > 0 ? left[tx - 1] : 0) + 1 : 0;
+    }
+}
+
+// 重算第 tx 列块的上下连续空块数
+static void refresh_col_runs(struct tiles* t, int tx) {
+    int tw = t->tw, ty;
+    for (ty = t->th - 1; ty >= 0; ty--) {
+        int k = ty * tw + tx;
+        t->run[2][k] = t->nblock[k] == 0 ? (ty + 1 < t->th ? t->run[2][k + tw] : 0) + 1 : 0;
+    }
+    for (ty = 0; ty < t->th; ty++) {
+        int k = ty * tw + tx;
+        t->run[3][k] = t->nblock[k] == 0 ? (ty > 0 ? t->run[3][k - tw] : 0) + 1 : 0;
+    }
+}
+
+void tiles_build(Map* m) {
+    tiles_free(m);
+    struct tiles* t = (struct tiles*)malloc(sizeof(struct tiles));
+    t->tw = (m->width + TILE_SIZE - 1) >> TILE_SHIFT;
+    t->th = (m->height + TILE_SIZE - 1) >> TILE_SHIFT;
+    t->nblock = (unsigned short*)calloc(t->tw * t->th, sizeof(unsigned short));
+    int x, y, k;
+    for (k = 0; k < 4; k++) {
+        t->run[k] = (unsigned short*)malloc(t->tw * t->th * sizeof(unsigned short));
+    }
+    for (y = 0; y < m->height; y++) {
+        unsigned short* row = t->nblock + (y >> TILE_SHIFT) * t->tw;
+        for (x = 0; x < m->width; x++) {
+            if (map_blocked(m, y * m->width + x)) {
+                row[x >> TILE_SHIFT]++;
+            }
+        }
+    }
+    for (y = 0; y < t->th; y++) {
+        refresh_row_runs(t, y);
+    }
+    for (x = 0; x < t->tw; x++) {
+        refresh_col_runs(t, x);
+    }
+    m->tiles = t;
+}
+
+void tiles_free(Map* m) {
+    struct tiles* t = m->tiles;
+    if (!t) {
+        return;
+    }
+    int k;
+    free(t->nblock);
+    for (k = 0; k < 4; k++) {
+        free(t->run[k]);
+    }
+    free(t);
+    m->tiles = NULL;
+}
+
+void tiles_update(Map* m, int pos, int blocked) {
+    struct tiles* t = m->tiles;
+    int x = pos % m->width, y = pos / m->width;
+    int k = (y >> TILE_SHIFT) * t->tw + (x >> TILE_SHIFT);
+    int was_clear = t->nblock[k] == 0;
+    if (blocked) {
+        t->nblock[k]++;
+    } else {
+        t->nblock[k]--;
+    }
+    // 只有空与不空之间的变化会影响连续空块数
+    if (was_clear != (t->nblock[k] == 0)) {
+        refresh_row_runs(t, y >> TILE_SHIFT);
+        refresh_col_runs(t, x >> TILE_SHIFT);
+    }
+}
+
+size_t tiles_memory(Map* m) {
+    struct tiles* t = m->tiles;
+    if (!t) {
+        return 0;
+    }
+    return sizeof(struct tiles) + t->tw * t->th * 5 * sizeof(unsigned short);
+}
+
+int tiles_rect_clear(const struct tiles* t, int x0, int y0, int x1, int y1) {
+    int tx, ty;
+    for (ty = y0 >> TILE_SHIFT; ty <= y1 >> TILE_SHIFT; ty++) {
+        for (tx = x0 >> TILE_SHIFT; tx <= x1 >> TILE_SHIFT; tx++) {
+            if (t->nblock[ty * t->tw + tx] != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,52 @@
+#ifndef __TILE_H__
+#define __TILE_H__ 0
+
+#include "map.h"
+
+#define TILE_SHIFT 6
+#define TILE_SIZE (1 << TILE_SHIFT)
+
+/*
+    地图按 TILE_SIZE x TILE_SIZE 分块, 统计每块的阻挡格数, 只用来跳过没有阻挡的空块:
+    跳点的直线扫描一次查表跨过整段空块, 视线检测在矩形只覆盖空块时直接判定可通过.
+    阻挡位图仍是逐格的, 内存不随阻挡分布变少, 逐格的 map_walkable 也不查分块.
+    由 map_set_block 等增量维护
+*/
+struct tiles {
+    int tw; // 横向块数
+    int th;
+    unsigned short* nblock; // 每块的阻挡格数, 0 表示空块
+    /*
+        从每块起沿一个方向连续空块的个数(含自身), 本块不空时为 0, 下标同 nblock.
+        依次为向右、向左、向下、向上, 扫描时一次查表就能跨过整段空块
+    */
+    unsigned short* run[4];
+};
+
+void tiles_build(Map* m);
+void tiles_free(Map* m);
+// pos 的阻挡状态刚发生变化后调用
+void tiles_update(Map* m, int pos, int blocked);
+size_t tiles_memory(Map* m);
+
+// [x0, x1] x [y0, y1] 覆盖的块是否都没有阻挡, 坐标要在地图内
+int tiles_rect_clear(const struct tiles* t, int x0, int y0, int x1, int y1);
+
+/*
+    沿第 line 行(vertical 为真时是第 line 列)从第 k 块起向 forward 方向扫描时, 本行(列)连同两侧相邻行(列)
+    所在的块连续都没有阻挡的块数, 这一段上既没有阻挡也没有强迫邻居.
+    地图外的行当作没有阻挡, 与跳点扫描时边框的效果一致. 相邻行最多落在两行块里
+*/
+static inline int tiles_line_run(const struct tiles* t, int vertical, int line, int len, int k, int forward) {
+    int lo = line > 0 ? (line - 1) >> TILE_SHIFT : 0;
+    int hi = line < len - 1 ? (line + 1) >> TILE_SHIFT : line >> TILE_SHIFT;
+    const unsigned short* run = t->run[vertical * 2 + !forward];
+    int n = run[vertical ? k * t->tw + lo : lo * t->tw + k];
+    if (hi != lo && n) {
+        int m = run[vertical ? k * t->tw + hi : hi * t->tw + k];
+        n = m < n ? m : n;
+    }
+    return n;
+}
+
+#endif /* __TILE_H__ */